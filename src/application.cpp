@@ -7,8 +7,12 @@ application::application()
 {
 }
 
-void application::init()
+void application::init(const std::string& scene_path)
 {
+	load(scene_path);
+	tracer::get().name_thread("ui");
+	renderer.start();
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
@@ -140,6 +144,22 @@ void application::init()
 	// a.keyframes.push_back(std::make_pair(4.0f, glm::vec3{0, 2, -3}));
 }
 
+// loads a text or binary scene file, the built-in default scene is used when no path is given or loading fails
+void application::load(const std::string& scene_path)
+{
+	scene_load_stats stats{};
+	if (!scene_path.empty())
+	{
+		if (load_scene(rt, scene_path, stats))
+		{
+			std::cout << "loaded " << scene_path << ": " << stats.objects << " objects, " << stats.lights << " lights in " << stats.ms << " ms" << std::endl;
+			return;
+		}
+		std::cout << "Failed to load scene " << scene_path << ": " << stats.error << std::endl;
+	}
+	load_scene_text(rt, default_scene_text, stats);
+}
+
 void application::loop()
 {
 	// render loop
@@ -196,15 +216,19 @@ void application::loop()
 			{
 				if (ImGui::Button("Add Material"))
 				{
-					rt.materials.push_back(new material{});
+					rt.materials.push_back(material{});
 				}
 				ImGui::SameLine();
 				if (ImGui::Button("Remove Last"))
 				{
 					if (rt.materials.size() > 1)
 					{
-						delete rt.materials.back();
 						rt.materials.pop_back();
+						for (int& m : rt.geo.mat)
+						{
+							m = glm::min(m, (int)rt.materials.size() - 1);
+						}
+						changes |= scene_objects;
 					}
 				}
 
@@ -215,17 +239,21 @@ void application::loop()
 					{
 						ImGui::Text("ambient :");
 						ImGui::SameLine();
-						ImGui::SliderFloat(("##matamb"+str).c_str(), &rt.materials[i]->k_a, 0, 1);
+						bool edited{ImGui::SliderFloat(("##matamb"+str).c_str(), &rt.materials[i].k_a, 0, 1)};
 						ImGui::Text("diffuse :");
 						ImGui::SameLine();
-						ImGui::SliderFloat(("##matdiff"+str).c_str(), &rt.materials[i]->k_d, 0, 1);
+						edited |= ImGui::SliderFloat(("##matdiff"+str).c_str(), &rt.materials[i].k_d, 0, 1);
 						ImGui::Text("specular:");
 						ImGui::SameLine();
-						ImGui::SliderFloat(("##matspec"+str).c_str(), &rt.materials[i]->k_s, 0, 1);
+						edited |= ImGui::SliderFloat(("##matspec"+str).c_str(), &rt.materials[i].k_s, 0, 1);
 						ImGui::Text("shine   :");
 						ImGui::SameLine();
-						ImGui::SliderInt(("##matshine"+str).c_str(), &rt.materials[i]->p, 1, 100);
-						ImGui::Checkbox("Glazed", &rt.materials[i]->glazed);
+						edited |= ImGui::SliderInt(("##matshine"+str).c_str(), &rt.materials[i].p, 1, 100);
+						edited |= ImGui::Checkbox("Glazed", &rt.materials[i].glazed);
+						if (edited)
+						{
+							changes |= scene_objects;
+						}
 						ImGui::NewLine();
 						ImGui::TreePop();
 					}
@@ -244,63 +272,117 @@ void application::loop()
 				{
 					rt.addTriangle();
 				}
-				ImGui::SameLine();
-				if (ImGui::Button("Remove Last"))
+				if (rt.geo.meshes() > 0)
 				{
-					if (rt.scene.size() > 0)
+					ImGui::SameLine();
+					if (ImGui::Button("Add Instance"))
 					{
-						delete rt.scene.back();
-						rt.scene.pop_back();
+						rt.addInstance();
 					}
 				}
+				ImGui::SameLine();
+				if (ImGui::Button("Remove Last"))
+				{
+					rt.geo.pop_back();
+				}
 
-				for (int i{}; i < rt.scene.size(); i++)
+				for (int i{}; i < rt.geo.size(); i++)
 				{
 					std::string str{std::to_string(i)};
-					ImGui::Checkbox(("##obj"+str).c_str(), &rt.scene[i]->visible);
+					bool visible{rt.geo.visible[i] != 0};
+					if (ImGui::Checkbox(("##obj"+str).c_str(), &visible))
+					{
+						rt.geo.visible[i] = visible;
+						changes |= scene_objects;
+					}
 					ImGui::SameLine();
-					if (ImGui::TreeNode(dynamic_cast<sphere*>(rt.scene[i]) ? ("Sphere "+str).c_str() : ("Triangle "+str).c_str()))
+					bool is_sphere{rt.geo.kind[i] == shape::sphere};
+					bool is_instance{rt.geo.kind[i] == shape::instance};
+					int idx{rt.geo.index[i]};
+					std::string name{is_sphere ? "Sphere " : is_instance ? "Instance " : "Triangle "};
+					if (ImGui::TreeNode((name+str).c_str()))
 					{
-						if (dynamic_cast<sphere*>(rt.scene[i]))
+						if (is_sphere)
 						{
 							ImGui::Text("color :");
 							ImGui::SameLine();
-							ImGui::ColorEdit3(("##sphere"+str).c_str(), (float*)&rt.scene[i]->color);
+							if (ImGui::ColorEdit3(("##sphere"+str).c_str(), (float*)&rt.geo.color[i]))
+							{
+								changes |= scene_objects;
+							}
 							ImGui::Text("center:");
 							ImGui::SameLine();
-							ImGui::SliderFloat3(("##sphere"+str).c_str(), (float*)&rt.scene[i]->center, -5, 5);
+							if (ImGui::SliderFloat3(("##sphere"+str).c_str(), (float*)&rt.geo.sphere_center[idx], -5, 5))
+							{
+								rt.geo.touch(i);
+							}
 							ImGui::Text("radius:");
 							ImGui::SameLine();
-							ImGui::SliderFloat(("##sphere"+str).c_str(), (float*)&dynamic_cast<sphere*>(rt.scene[i])->r, 0.1, 5);
+							if (ImGui::SliderFloat(("##sphere"+str).c_str(), &rt.geo.sphere_radius[idx], 0.1, 5))
+							{
+								rt.geo.touch(i);
+							}
+						}
+						else if (is_instance)
+						{
+							ImGui::Text("mesh  : %d", rt.geo.inst_mesh[idx]);
+							ImGui::Text("color :");
+							ImGui::SameLine();
+							if (ImGui::ColorEdit3(("##inst"+str).c_str(), (float*)&rt.geo.color[i]))
+							{
+								changes |= scene_objects;
+							}
+							ImGui::Text("position:");
+							ImGui::SameLine();
+							if (ImGui::SliderFloat3(("##instpos"+str).c_str(), (float*)&rt.geo.inst_transform[idx][3], -5, 5))
+							{
+								rt.geo.touch(i);
+							}
 						}
 						else
 						{
-							triangle* t = dynamic_cast<triangle*>(rt.scene[i]);
+							bool plane{rt.geo.tri_plane[idx] != 0};
 							ImGui::Text("plane :");
 							ImGui::SameLine();
-							ImGui::Checkbox("##tri", &t->plane);
+							if (ImGui::Checkbox("##tri", &plane))
+							{
+								rt.geo.tri_plane[idx] = plane;
+								rt.geo.dirty = true;
+							}
 							ImGui::Text("color :");
 							ImGui::SameLine();
-							ImGui::ColorEdit3(("##tri"+str).c_str(), (float*)&t->color);
+							if (ImGui::ColorEdit3(("##tri"+str).c_str(), (float*)&rt.geo.color[i]))
+							{
+								changes |= scene_objects;
+							}
 							ImGui::Text("p1:");
 							ImGui::SameLine();
-							ImGui::SliderFloat3(("##tri1"+str).c_str(), (float*)&t->p1, -5, 5);
+							if (ImGui::SliderFloat3(("##tri1"+str).c_str(), (float*)&rt.geo.tri_p1[idx], -5, 5))
+							{
+								rt.geo.touch(i);
+							}
 							ImGui::Text("p2:");
 							ImGui::SameLine();
-							ImGui::SliderFloat3(("##tri2"+str).c_str(), (float*)&t->p2, -5, 5);
+							if (ImGui::SliderFloat3(("##tri2"+str).c_str(), (float*)&rt.geo.tri_p2[idx], -5, 5))
+							{
+								rt.geo.touch(i);
+							}
 							ImGui::Text("p3:");
 							ImGui::SameLine();
-							ImGui::SliderFloat3(("##tri3"+str).c_str(), (float*)&t->p3, -5, 5);
+							if (ImGui::SliderFloat3(("##tri3"+str).c_str(), (float*)&rt.geo.tri_p3[idx], -5, 5))
+							{
+								rt.geo.touch(i);
+							}
 						}
-						if (ImGui::BeginCombo("##material", ("Material "+std::to_string(rt.scene[i]->mat_idx)).c_str()))
+						if (ImGui::BeginCombo("##material", ("Material "+std::to_string(rt.geo.mat[i])).c_str()))
 						{
 							for (int j{}; j < rt.materials.size(); j++)
 							{
-								const bool is_selected{rt.scene[i]->mat_idx==j};
+								const bool is_selected{rt.geo.mat[i]==j};
 								if (ImGui::Selectable(("Material "+std::to_string(j)).c_str(), is_selected))
 								{
-									rt.scene[i]->mat_idx=j;
-									rt.scene[i]->m=rt.materials[j];
+									rt.geo.mat[i]=j;
+									changes |= scene_objects;
 								}
 
 								if (is_selected)
@@ -347,7 +429,61 @@ void application::loop()
 			}
 			if (ImGui::CollapsingHeader("Shading"))
 			{
-				ImGui::SliderInt("bounce count", &rt.bounce_count, 0, 5);
+				ImGui::SliderInt("bounce count", &rt.bounce_count, 0, 16);
+				ImGui::SliderFloat("min throughput", &rt.min_throughput, 0.0f, 0.1f, "%.4f");
+				ImGui::Checkbox("bvh", &rt.use_bvh);
+				ImGui::SameLine();
+				ImGui::Checkbox("wide", &rt.wide_bvh);
+				ImGui::SameLine();
+				ImGui::Text("last build: %.2f ms", renderer.build_ms());
+				ImGui::Checkbox("progressive", &rt.progressive);
+				ImGui::SameLine();
+				ImGui::Checkbox("packets", &rt.packets);
+				ImGui::SameLine();
+				ImGui::Checkbox("wavefront", &rt.wavefront);
+				ImGui::Checkbox("shading cache", &rt.shading_cache);
+				ImGui::SameLine();
+				ImGui::Checkbox("light layers", &rt.relight_layers);
+				ImGui::SliderInt("threads", &rt.thread_count, 0, 64);
+				ImGui::SliderInt("tile size", &rt.tile_size, 4, 64);
+			}
+
+			if (ImGui::CollapsingHeader("Stats"))
+			{
+				render_thread::pass_stats s{renderer.stats()};
+				render_counts& c{s.counts};
+				ImGui::Checkbox("timers", &rt.timers);
+				int view{static_cast<int>(rt.heatmap)};
+				if (ImGui::Combo("heatmap", &view, heatmap_names, IM_ARRAYSIZE(heatmap_names)))
+				{
+					rt.heatmap = static_cast<heatmap_view>(view);
+				}
+				if (rt.heatmap != heatmap_view::off)
+				{
+					ImGui::Text("red is %u %s per pixel", s.heatmap_max, heatmap_names[view]);
+				}
+				ImGui::SliderInt("##traceframes", &trace_frames, 1, 64);
+				ImGui::SameLine();
+				if (ImGui::Button("Trace frames"))
+				{
+					tracer::get().start(trace_frames, "images/trace.json");
+				}
+				if (tracer::on)
+				{
+					ImGui::Text("tracing...");
+				}
+				else if (tracer::get().written)
+				{
+					ImGui::Text("wrote images/trace.json");
+				}
+				ImGui::Text("last pass: %s, %.2f ms", s.step == 0 ? "export" : (std::to_string(s.step) + "x" + std::to_string(s.step) + " blocks").c_str(), s.ms);
+				ImGui::Text("rays   primary %llu  shadow %llu  reflection %llu", c.primary, c.shadow, c.reflection);
+				ImGui::Text("tests  sphere %llu  triangle %llu  instance %llu", c.sphere_tests, c.triangle_tests, c.instance_tests);
+				if (rt.timers)
+				{
+					// summed over the threads, the shader includes the reflection hits and shadow rays it traces
+					ImGui::Text("time   calculate_hit %.2f ms  shader %.2f ms  shadow rays %.2f ms", c.hit_ns / 1e6, c.shader_ns / 1e6, c.shadow_ns / 1e6);
+				}
 			}
 
 			if (ImGui::CollapsingHeader("Export"))
@@ -358,7 +494,7 @@ void application::loop()
 				if (ImGui::Button("Save"))
 				{
 					// save picture
-					rt.export_image("Image.jpg");
+					submit("Image.jpg");
 				}
 				ImGui::NewLine();
 			}
@@ -408,7 +544,8 @@ void application::loop()
 		}
 		lastTime = time;
 
-		if (!freemove)
+		// video frames wait for the previous one to be saved so none are dropped
+		if (!freemove && !renderer.busy())
 		{
 			// rt.lightAnimation(videoTime);
 			keyframe k{a.get_keyframe(videoTime)};
@@ -416,23 +553,26 @@ void application::loop()
 			rt.cam.d=k.depth;
 			rt.lookat(glm::vec3{0, 1, 0});
 			videoTime+=maxVideoPeriod;
-			// rt.lookat(rt.scene[0]->center);
-			rt.scene[rt.scene.size()-2]->center.x=glm::sin(videoTime)*5-3;
-			rt.scene[rt.scene.size()-2]->center.y=glm::cos(videoTime)*1+2;
-			rt.scene[rt.scene.size()-2]->center.z=glm::cos(videoTime)*5+1;
-			rt.export_image("frame_"+std::to_string(frameCount)+".jpg");
+			// rt.lookat(rt.geo.sphere_center[0]);
+			animate_object(videoTime);
+			submit("frame_"+std::to_string(frameCount)+".jpg");
 			frameCount++;
 			
 		}
-		else
+		else if (freemove)
 		{
 			// rt.lightAnimation(time);
-			rt.update_image();
-			rt.scene[rt.scene.size()-2]->center.x=glm::sin(time)*5-3;
-			rt.scene[rt.scene.size()-2]->center.y=glm::cos(time)*1+2;
-			rt.scene[rt.scene.size()-2]->center.z=glm::cos(time)*5+1;
+			submit();
+			animate_object(time);
 		}
 
+		renderer.present([](unsigned char* image, int width, int height)
+		{
+			trace_scope scope{"upload"};
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		});
+
 		
 
 		// input
@@ -463,8 +603,42 @@ void application::loop()
 	}
 }
 
+// orbits the second to last object of the scene when it is a sphere
+void application::animate_object(float t)
+{
+	int obj{rt.geo.size()-2};
+	if (obj < 0 || rt.geo.kind[obj] != shape::sphere)
+	{
+		return;
+	}
+	glm::vec3& center{rt.geo.sphere_center[rt.geo.index[obj]]};
+	center.x=glm::sin(t)*5-3;
+	center.y=glm::cos(t)*1+2;
+	center.z=glm::cos(t)*5+1;
+	rt.geo.touch(obj);
+}
+
+// hands the edited scene to the render thread, the dirty flag and moved list of rt only track edits since the last submit
+void application::submit(const std::string& export_path)
+{
+	if (rt.geo.dirty)
+	{
+		changes |= scene_geometry;
+		rt.geo.dirty = false;
+	}
+	else if (!rt.geo.moved.empty())
+	{
+		changes |= scene_moved;
+	}
+	renderer.submit(rt, changes, export_path);
+	rt.geo.moved.clear();
+	changes = 0;
+}
+
 void application::close()
 {
+	renderer.stop();
+
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
 	glDeleteVertexArrays(1, &VAO);
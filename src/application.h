@@ -18,12 +18,17 @@
 
 #include "engine.h"
 #include "raytracer.h"
+#include "render_thread.h"
+#include "scene_io.h"
 #include "animation.h"
 
 class application
 {
 private:
 	void processInput(GLFWwindow *window);
+	void load(const std::string& scene_path);
+	void animate_object(float t);
+	void submit(const std::string& export_path="");
 	
 	// settings
 	const unsigned int SCR_WIDTH =  1364;
@@ -57,7 +62,10 @@ private:
 	unsigned int texture;
 	unsigned int VBO, VAO, EBO;
 
+	// rt is the scene the ui edits, renderer traces a copy of it on its own thread
 	ray_tracer rt{};
+	render_thread renderer{};
+	unsigned changes{scene_loaded};
 
 	const float maxFPS = 60;
 	const float maxPeriod = 1.0f / maxFPS;
@@ -74,6 +82,8 @@ private:
 	const float maxVideoPeriod=1.0f/videoFPS;
 	float videoTime{};
 
+	int trace_frames{8}; // frames recorded by a trace capture
+
 	ImGuiIO* ioptr{};
 
 	animation_manager a{};
@@ -83,7 +93,7 @@ public:
 	void process_keys(int key, int scancode, int action, int mods);
 	void framebuffer_size(int width, int height);
 	application();
-	void init();
+	void init(const std::string& scene_path="");
 	void loop();
 	void close();
 };
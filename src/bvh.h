@@ -0,0 +1,1230 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <chrono>
+
+#include "engine.h"
+#include "column.h"
+#include "thread_pool.h"
+
+// RT_NO_SIMD forces the scalar box test of the wide nodes
+#if !defined(RT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define RT_SSE
+#include <immintrin.h>
+#endif
+
+struct bvh_node
+{
+	aabb box{};
+	int first{}; // first child for inner nodes, first index for leaves
+	int count{}; // number of primitives, 0 for inner nodes
+};
+
+// rays traced through the tree together, such as the primary rays of a 4x4 block of pixels.
+// bound() takes the interval of the origins and inverse directions of the active rays, a packet is coherent
+// when along every axis its directions are all positive, all negative or all zero, otherwise it is traced ray by ray
+struct ray_packet
+{
+	static constexpr int capacity{16};
+	ray rays[capacity]{};
+	glm::vec3 inv_d[capacity]{};
+	int count{};
+
+	glm::vec3 origin_lo{};
+	glm::vec3 origin_hi{};
+	glm::vec3 inv_lo{};
+	glm::vec3 inv_hi{};
+	bool parallel[3]{}; // no ray moves along this axis
+	bool coherent{false};
+
+	void add(const ray& r)
+	{
+		rays[count] = r;
+		inv_d[count] = 1.0f / r.d;
+		count++;
+	}
+
+	unsigned all() const
+	{
+		return (1u << count) - 1;
+	}
+
+	void bound(unsigned active)
+	{
+		origin_lo = inv_lo = glm::vec3{INF};
+		origin_hi = inv_hi = glm::vec3{-INF};
+		int positive[3]{};
+		int negative[3]{};
+		int rays_in{};
+		for (int k{}; k < count; k++)
+		{
+			if (!(active >> k & 1))
+			{
+				continue;
+			}
+			rays_in++;
+			origin_lo = glm::min(origin_lo, rays[k].p);
+			origin_hi = glm::max(origin_hi, rays[k].p);
+			inv_lo = glm::min(inv_lo, inv_d[k]);
+			inv_hi = glm::max(inv_hi, inv_d[k]);
+			for (int a{}; a < 3; a++)
+			{
+				positive[a] += rays[k].d[a] > 0;
+				negative[a] += rays[k].d[a] < 0;
+			}
+		}
+		coherent = rays_in > 0;
+		for (int a{}; a < 3; a++)
+		{
+			parallel[a] = positive[a] == 0 && negative[a] == 0;
+			coherent = coherent && (parallel[a] || positive[a] == rays_in || negative[a] == rays_in);
+		}
+	}
+};
+
+// up to four children of the collapsed tree with their boxes stored per axis, one slab test checks all of them.
+// child is a wide node for inner children and the first index for leaves, count is -1 for unused lanes
+struct alignas(64) wide_node
+{
+	float min_x[4]{};
+	float min_y[4]{};
+	float min_z[4]{};
+	float max_x[4]{};
+	float max_y[4]{};
+	float max_z[4]{};
+	int child[4]{};
+	int count[4]{-1, -1, -1, -1};
+
+	void set_box(int lane, const aabb& b)
+	{
+		min_x[lane] = b.min.x;
+		min_y[lane] = b.min.y;
+		min_z[lane] = b.min.z;
+		max_x[lane] = b.max.x;
+		max_y[lane] = b.max.y;
+		max_z[lane] = b.max.z;
+	}
+
+	// bit i is set when the ray enters child i before tmax, tnear[i] is its entry distance.
+	// matches aabb::intersect bit for bit, including rays parallel to a slab
+	int intersect(glm::vec3 p, glm::vec3 inv_d, float tmax, float tnear[4]) const
+	{
+#ifdef RT_SSE
+		__m128 t0x{_mm_mul_ps(_mm_sub_ps(_mm_load_ps(min_x), _mm_set1_ps(p.x)), _mm_set1_ps(inv_d.x))};
+		__m128 t0y{_mm_mul_ps(_mm_sub_ps(_mm_load_ps(min_y), _mm_set1_ps(p.y)), _mm_set1_ps(inv_d.y))};
+		__m128 t0z{_mm_mul_ps(_mm_sub_ps(_mm_load_ps(min_z), _mm_set1_ps(p.z)), _mm_set1_ps(inv_d.z))};
+		__m128 t1x{_mm_mul_ps(_mm_sub_ps(_mm_load_ps(max_x), _mm_set1_ps(p.x)), _mm_set1_ps(inv_d.x))};
+		__m128 t1y{_mm_mul_ps(_mm_sub_ps(_mm_load_ps(max_y), _mm_set1_ps(p.y)), _mm_set1_ps(inv_d.y))};
+		__m128 t1z{_mm_mul_ps(_mm_sub_ps(_mm_load_ps(max_z), _mm_set1_ps(p.z)), _mm_set1_ps(inv_d.z))};
+		// glm::min(a, b) is b < a ? b : a, which is _mm_min_ps(b, a) and picks the same operand for nan,
+		// and glm::max(a, b) is _mm_max_ps(b, a)
+		__m128 t_enter{_mm_max_ps(_mm_min_ps(t1z, t0z), _mm_max_ps(_mm_min_ps(t1y, t0y), _mm_min_ps(t1x, t0x)))};
+		__m128 t_exit{_mm_min_ps(_mm_min_ps(_mm_set1_ps(tmax), _mm_max_ps(t1z, t0z)), _mm_min_ps(_mm_max_ps(t1y, t0y), _mm_max_ps(t1x, t0x)))};
+		__m128 hit{_mm_and_ps(_mm_cmple_ps(t_enter, t_exit), _mm_cmpge_ps(t_exit, _mm_setzero_ps()))};
+		__m128i used{_mm_cmpgt_epi32(_mm_load_si128((const __m128i*)count), _mm_set1_epi32(-1))};
+		_mm_storeu_ps(tnear, t_enter);
+		return _mm_movemask_ps(_mm_and_ps(hit, _mm_castsi128_ps(used)));
+#else
+		int mask{};
+		for (int i{}; i < 4; i++)
+		{
+			if (count[i] >= 0 && box(i).intersect(ray{p, {}}, inv_d, tmax, tnear[i]))
+			{
+				mask |= 1 << i;
+			}
+		}
+		return mask;
+#endif
+	}
+
+	// conservative test of a coherent packet, a lane is set when any of its rays may enter the child before tmax.
+	// the entry and exit distances of each slab are bounded with interval arithmetic over the packet bounds,
+	// tnear[i] is a lower bound of the entry distance of every ray of the packet
+	int intersect(const ray_packet& pk, float tmax, float tnear[4]) const
+	{
+		const float* lo[3]{min_x, min_y, min_z};
+		const float* hi[3]{max_x, max_y, max_z};
+#ifdef RT_SSE
+		__m128 t_enter{_mm_set1_ps(-INF)};
+		__m128 t_exit{_mm_set1_ps(tmax)};
+		for (int a{}; a < 3; a++)
+		{
+			__m128 b_lo{_mm_load_ps(lo[a])};
+			__m128 b_hi{_mm_load_ps(hi[a])};
+			__m128 o_lo{_mm_set1_ps(pk.origin_lo[a])};
+			__m128 o_hi{_mm_set1_ps(pk.origin_hi[a])};
+			if (pk.parallel[a])
+			{
+				// the slab is either never left or never entered
+				__m128 inside{_mm_and_ps(_mm_cmple_ps(b_lo, o_hi), _mm_cmpge_ps(b_hi, o_lo))};
+				t_exit = _mm_min_ps(t_exit, _mm_or_ps(_mm_and_ps(inside, _mm_set1_ps(INF)), _mm_andnot_ps(inside, _mm_set1_ps(-INF))));
+				continue;
+			}
+			__m128 i_lo{_mm_set1_ps(pk.inv_lo[a])};
+			__m128 i_hi{_mm_set1_ps(pk.inv_hi[a])};
+			__m128 entry_plane{pk.inv_lo[a] > 0 ? b_lo : b_hi};
+			__m128 exit_plane{pk.inv_lo[a] > 0 ? b_hi : b_lo};
+			__m128 e0{_mm_sub_ps(entry_plane, o_lo)};
+			__m128 e1{_mm_sub_ps(entry_plane, o_hi)};
+			__m128 x0{_mm_sub_ps(exit_plane, o_lo)};
+			__m128 x1{_mm_sub_ps(exit_plane, o_hi)};
+			__m128 enter_lo{_mm_min_ps(_mm_min_ps(_mm_mul_ps(e0, i_lo), _mm_mul_ps(e0, i_hi)), _mm_min_ps(_mm_mul_ps(e1, i_lo), _mm_mul_ps(e1, i_hi)))};
+			__m128 exit_hi{_mm_max_ps(_mm_max_ps(_mm_mul_ps(x0, i_lo), _mm_mul_ps(x0, i_hi)), _mm_max_ps(_mm_mul_ps(x1, i_lo), _mm_mul_ps(x1, i_hi)))};
+			t_enter = _mm_max_ps(t_enter, enter_lo);
+			t_exit = _mm_min_ps(t_exit, exit_hi);
+		}
+		__m128 hit{_mm_and_ps(_mm_cmple_ps(t_enter, t_exit), _mm_cmpge_ps(t_exit, _mm_setzero_ps()))};
+		__m128i used{_mm_cmpgt_epi32(_mm_load_si128((const __m128i*)count), _mm_set1_epi32(-1))};
+		_mm_storeu_ps(tnear, t_enter);
+		return _mm_movemask_ps(_mm_and_ps(hit, _mm_castsi128_ps(used)));
+#else
+		int mask{};
+		for (int i{}; i < 4; i++)
+		{
+			float t_enter{-INF};
+			float t_exit{tmax};
+			for (int a{}; a < 3; a++)
+			{
+				if (pk.parallel[a])
+				{
+					bool inside{lo[a][i] <= pk.origin_hi[a] && hi[a][i] >= pk.origin_lo[a]};
+					t_exit = glm::min(t_exit, static_cast<float>(inside ? INF : -INF));
+					continue;
+				}
+				float entry_plane{pk.inv_lo[a] > 0 ? lo[a][i] : hi[a][i]};
+				float exit_plane{pk.inv_lo[a] > 0 ? hi[a][i] : lo[a][i]};
+				float e0{entry_plane - pk.origin_lo[a]};
+				float e1{entry_plane - pk.origin_hi[a]};
+				float x0{exit_plane - pk.origin_lo[a]};
+				float x1{exit_plane - pk.origin_hi[a]};
+				t_enter = glm::max(t_enter, glm::min(glm::min(e0 * pk.inv_lo[a], e0 * pk.inv_hi[a]), glm::min(e1 * pk.inv_lo[a], e1 * pk.inv_hi[a])));
+				t_exit = glm::min(t_exit, glm::max(glm::max(x0 * pk.inv_lo[a], x0 * pk.inv_hi[a]), glm::max(x1 * pk.inv_lo[a], x1 * pk.inv_hi[a])));
+			}
+			tnear[i] = t_enter;
+			if (count[i] >= 0 && t_enter <= t_exit && t_exit >= 0)
+			{
+				mask |= 1 << i;
+			}
+		}
+		return mask;
+#endif
+	}
+
+	aabb box(int lane) const
+	{
+		return aabb{{min_x[lane], min_y[lane], min_z[lane]}, {max_x[lane], max_y[lane], max_z[lane]}};
+	}
+};
+
+// bounding volume hierarchy over primitive ids, built with the surface area heuristic.
+// moved primitives are refitted along their path to the root and the tree asks for a rebuild
+// once its sah cost has grown past rebuild_threshold times the cost it had when it was built.
+// traversal runs on a 4-wide copy collapsed from the binary nodes, the binary nodes stay the source for refits
+struct bvh
+{
+	column<bvh_node> nodes{};
+	column<int> indices{};
+	column<wide_node> wide_nodes{};
+	bool wide_traversal{true}; // false traverses the binary nodes, for comparison
+
+	// filled by link(), a mapped snapshot gets them on its first refit
+	std::vector<int> parents{};
+	std::vector<int> leaf_of{}; // leaf node of every primitive id, -1 when it is not in the tree
+	double weighted_area{}; // sah cost times the root area, kept up to date by refit
+	double built_cost{};
+	std::vector<int> wide_slot{}; // wide node * 4 + lane holding every binary node, -1 when it was collapsed away
+
+	// stack entries the traversals of the calling thread popped, a packet counts once per entry
+	static inline thread_local unsigned long long visited{};
+
+	static constexpr int max_depth{48};
+	static constexpr float traversal_cost{1.0f};
+	static constexpr float intersection_cost{1.0f};
+	static constexpr float rebuild_threshold{1.5f};
+	static constexpr int bin_count{16};
+	static constexpr int parallel_threshold{1 << 16}; // nodes this large bin on every worker
+	static constexpr int subtree_threshold{1 << 12}; // smallest subtree handed to a single worker
+	static constexpr int wide_stack{3 * max_depth + 8}; // every wide level pushes at most three more entries than it pops
+	// a packet whose leaves are entered by fewer rays than this on average has diverged, its rays finish alone
+	static constexpr int packet_leaves{4};
+	static constexpr float packet_rays_per_leaf{3.0f};
+
+	double build_ms{}; // duration of the last build
+
+	// binned sah build, boxes are indexed by primitive id. with a pool the top levels are split level by level,
+	// large nodes bin in parallel and the levels below run as independent subtrees on the workers
+	void build(const std::vector<aabb>& boxes, const std::vector<int>& prims, thread_pool* pool=nullptr)
+	{
+		auto start{std::chrono::steady_clock::now()};
+		nodes.clear();
+		indices = prims;
+		if (indices.empty())
+		{
+			build_ms = 0.0;
+			return;
+		}
+		nodes.reserve(indices.size() * 2);
+		nodes.push_back(bvh_node{});
+		refs.resize(indices.size());
+		for (size_t i{}; i < indices.size(); i++)
+		{
+			refs[i] = build_ref{boxes[indices[i]], boxes[indices[i]].centroid(), indices[i]};
+		}
+
+		struct task
+		{
+			int node, first, count, depth;
+		};
+		int threads{pool ? pool->size() : 1};
+		int subtree_size{std::max(subtree_threshold, (int)indices.size() / (threads * 8))};
+		std::vector<task> open{};
+		std::vector<task> subtrees{};
+		(threads > 1 && (int)indices.size() > subtree_size ? open : subtrees).push_back(task{0, 0, (int)indices.size(), 0});
+		while (!open.empty())
+		{
+			// nodes of one level are independent, a single node spreads its binning over the pool instead
+			std::vector<split_result> results(open.size());
+			auto split_one{[&](int t, int)
+			{
+				results[t] = split(open[t].first, open[t].count, open[t].depth, open.size() == 1 ? pool : nullptr);
+			}};
+			if (open.size() == 1)
+			{
+				split_one(0, 0);
+			}
+			else
+			{
+				pool->run(open.size(), split_one);
+			}
+
+			std::vector<task> next{};
+			for (size_t t{}; t < open.size(); t++)
+			{
+				const task& o{open[t]};
+				const split_result& r{results[t]};
+				if (r.left < 0)
+				{
+					nodes[o.node] = bvh_node{r.box, o.first, o.count};
+					continue;
+				}
+				int child{static_cast<int>(nodes.size())};
+				nodes.push_back(bvh_node{});
+				nodes.push_back(bvh_node{});
+				nodes[o.node] = bvh_node{r.box, child, 0};
+				for (task c : {task{child, o.first, r.left, o.depth + 1}, task{child + 1, o.first + r.left, o.count - r.left, o.depth + 1}})
+				{
+					(c.count > subtree_size ? next : subtrees).push_back(c);
+				}
+			}
+			open = std::move(next);
+		}
+
+		// every subtree is built into its own array and appended, child links are shifted to their final place
+		std::vector<std::vector<bvh_node>> built(subtrees.size());
+		auto build_subtree{[&](int t, int)
+		{
+			built[t].reserve(subtrees[t].count * 2);
+			built[t].push_back(bvh_node{});
+			subdivide(built[t], 0, subtrees[t].first, subtrees[t].count, subtrees[t].depth);
+		}};
+		if (pool && subtrees.size() > 1)
+		{
+			pool->run(subtrees.size(), build_subtree);
+		}
+		else
+		{
+			for (int t{}; t < subtrees.size(); t++)
+			{
+				build_subtree(t, 0);
+			}
+		}
+		for (size_t t{}; t < subtrees.size(); t++)
+		{
+			int base{static_cast<int>(nodes.size()) - 1};
+			for (size_t k{}; k < built[t].size(); k++)
+			{
+				bvh_node n{built[t][k]};
+				if (n.count == 0)
+				{
+					n.first += base;
+				}
+				if (k == 0)
+				{
+					nodes[subtrees[t].node] = n;
+				}
+				else
+				{
+					nodes.push_back(n);
+				}
+			}
+		}
+		for (size_t i{}; i < refs.size(); i++)
+		{
+			indices[i] = refs[i].id;
+		}
+		refs = {};
+		scratch = {};
+		link();
+		collapse();
+		build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool empty() const
+	{
+		return nodes.empty();
+	}
+
+	void clear()
+	{
+		nodes.clear();
+		indices.clear();
+		wide_nodes.clear();
+		wide_slot.clear();
+		build_ms = 0.0;
+	}
+
+	// expected cost of a ray against the tree relative to testing its root box
+	float cost() const
+	{
+		if (nodes.empty() || nodes[0].box.area() <= 0)
+		{
+			return 0.0f;
+		}
+		return weighted_area / nodes[0].box.area();
+	}
+
+	bool degraded() const
+	{
+		return cost() > built_cost * rebuild_threshold;
+	}
+
+	// updates the boxes above every moved primitive, bounds(id) returns its new box.
+	// a path stops early at the first node whose box did not change
+	template <typename F>
+	void refit(const std::vector<int>& moved, F&& bounds)
+	{
+		if (nodes.empty())
+		{
+			return;
+		}
+		if (parents.size() != nodes.size())
+		{
+			link();
+		}
+		if (wide_slot.size() != nodes.size())
+		{
+			collapse();
+		}
+		for (int id : moved)
+		{
+			int node{id < leaf_of.size() ? leaf_of[id] : -1};
+			while (node >= 0)
+			{
+				bvh_node& n{nodes[node]};
+				aabb box{};
+				if (n.count > 0)
+				{
+					for (int i{n.first}; i < n.first + n.count; i++)
+					{
+						box.grow(bounds(indices[i]));
+					}
+				}
+				else
+				{
+					box.grow(nodes[n.first].box);
+					box.grow(nodes[n.first + 1].box);
+				}
+				if (box == n.box)
+				{
+					break;
+				}
+				weighted_area += weight(n) * (box.area() - n.box.area());
+				n.box = box;
+				if (wide_slot[node] >= 0)
+				{
+					wide_nodes[wide_slot[node] / 4].set_box(wide_slot[node] % 4, box);
+				}
+				node = parents[node];
+			}
+		}
+	}
+
+	// closest hit, intersect(id) returns the hit_information of a single primitive
+	template <typename F>
+	void closest(ray& r, hit_information& h, F&& intersect) const
+	{
+		if (wide_traversal && !wide_nodes.empty())
+		{
+			closest_wide(r, h, intersect);
+		}
+		else
+		{
+			closest_binary(r, h, intersect);
+		}
+	}
+
+	// any hit before tmax, occludes(id) tests a single primitive and traversal stops at the first hit
+	template <typename F>
+	bool any(ray& r, float tmax, F&& occludes) const
+	{
+		if (wide_traversal && !wide_nodes.empty())
+		{
+			return any_wide(r, tmax, occludes);
+		}
+		return any_binary(r, tmax, occludes);
+	}
+
+	// closest hits of the active rays of a packet, h[k] belongs to rays[k] and intersect(id, k) tests primitive id
+	// against ray k. inner nodes are tested once for the whole packet, only leaves test the rays one by one.
+	// once the packet has diverged the rays continue on their own, bounded by the hits found so far
+	template <typename F>
+	void closest(ray_packet& pk, unsigned active, hit_information* h, F&& intersect) const
+	{
+		auto single{[&]
+		{
+			for (int k{}; k < pk.count; k++)
+			{
+				if (active >> k & 1)
+				{
+					closest(pk.rays[k], h[k], [&](int id) { return intersect(id, k); });
+				}
+			}
+		}};
+		pk.bound(active);
+		if (!pk.coherent || !wide_traversal || wide_nodes.empty())
+		{
+			single();
+			return;
+		}
+
+		auto farthest{[&]
+		{
+			float t{-INF};
+			for (int k{}; k < pk.count; k++)
+			{
+				if (active >> k & 1)
+				{
+					t = glm::max(t, h[k].t);
+				}
+			}
+			return t;
+		}};
+		float tmax{farthest()};
+		std::pair<int, float> stack[wide_stack];
+		int sp{};
+		stack[sp++] = {0, -INF};
+		int leaves{};
+		int entered{};
+		while (sp > 0)
+		{
+			auto [entry, tnear]{stack[--sp]};
+			visited++;
+			if (tnear > tmax)
+			{
+				continue;
+			}
+			if (entry < 0)
+			{
+				if (++leaves >= packet_leaves && entered < leaves * packet_rays_per_leaf)
+				{
+					single();
+					return;
+				}
+				const wide_node& leaf{wide_nodes[~entry / 4]};
+				aabb box{leaf.box(~entry % 4)};
+				int first{leaf.child[~entry % 4]};
+				for (int k{}; k < pk.count; k++)
+				{
+					float t{};
+					if (!(active >> k & 1) || !box.intersect(pk.rays[k], pk.inv_d[k], h[k].t, t))
+					{
+						continue;
+					}
+					entered++;
+					for (int i{first}; i < first + leaf.count[~entry % 4]; i++)
+					{
+						hit_information hit{intersect(indices[i], k)};
+						if (hit.hits != 0 && hit.t < h[k].t)
+						{
+							h[k] = hit;
+						}
+					}
+				}
+				tmax = farthest();
+				continue;
+			}
+
+			const wide_node& n{wide_nodes[entry]};
+			float t[4];
+			int mask{n.intersect(pk, tmax, t)};
+			int order[4];
+			int hits{};
+			for (int lane{}; lane < 4; lane++)
+			{
+				if (mask & (1 << lane))
+				{
+					int k{hits++};
+					for (; k > 0 && t[order[k - 1]] > t[lane]; k--)
+					{
+						order[k] = order[k - 1];
+					}
+					order[k] = lane;
+				}
+			}
+			for (int k{hits - 1}; k >= 0; k--)
+			{
+				int lane{order[k]};
+				stack[sp++] = {n.count[lane] > 0 ? ~(entry * 4 + lane) : n.child[lane], t[lane]};
+			}
+		}
+	}
+
+	// returns the active rays of a packet that hit something before their tmax, occludes(id, k) tests
+	// primitive id against ray k. rays leave the packet as soon as they are occluded
+	template <typename F>
+	unsigned any(ray_packet& pk, unsigned active, const float* tmax, F&& occludes) const
+	{
+		unsigned hit{};
+		auto single{[&]
+		{
+			for (int k{}; k < pk.count; k++)
+			{
+				if (((active & ~hit) >> k & 1) && any(pk.rays[k], tmax[k], [&](int id) { return occludes(id, k); }))
+				{
+					hit |= 1u << k;
+				}
+			}
+			return hit;
+		}};
+		pk.bound(active);
+		if (!pk.coherent || !wide_traversal || wide_nodes.empty())
+		{
+			return single();
+		}
+
+		float packet_tmax{-INF};
+		for (int k{}; k < pk.count; k++)
+		{
+			if (active >> k & 1)
+			{
+				packet_tmax = glm::max(packet_tmax, tmax[k]);
+			}
+		}
+		int stack[wide_stack];
+		int sp{};
+		stack[sp++] = 0;
+		int leaves{};
+		int entered{};
+		while (sp > 0 && hit != active)
+		{
+			int entry{stack[--sp]};
+			visited++;
+			if (entry < 0)
+			{
+				if (++leaves >= packet_leaves && entered < leaves * packet_rays_per_leaf)
+				{
+					return single();
+				}
+				const wide_node& leaf{wide_nodes[~entry / 4]};
+				aabb box{leaf.box(~entry % 4)};
+				int first{leaf.child[~entry % 4]};
+				for (int k{}; k < pk.count; k++)
+				{
+					float t{};
+					if (!((active & ~hit) >> k & 1) || !box.intersect(pk.rays[k], pk.inv_d[k], tmax[k], t))
+					{
+						continue;
+					}
+					entered++;
+					for (int i{first}; i < first + leaf.count[~entry % 4]; i++)
+					{
+						if (occludes(indices[i], k))
+						{
+							hit |= 1u << k;
+							break;
+						}
+					}
+				}
+				continue;
+			}
+			const wide_node& n{wide_nodes[entry]};
+			float t[4];
+			int mask{n.intersect(pk, packet_tmax, t)};
+			for (int lane{3}; lane >= 0; lane--)
+			{
+				if (mask & (1 << lane))
+				{
+					stack[sp++] = n.count[lane] > 0 ? ~(entry * 4 + lane) : n.child[lane];
+				}
+			}
+		}
+		return hit;
+	}
+
+	template <typename F>
+	void closest_binary(ray& r, hit_information& h, F&& intersect) const
+	{
+		if (nodes.empty())
+		{
+			return;
+		}
+		glm::vec3 inv_d{1.0f / r.d};
+		std::pair<int, float> stack[max_depth + 2];
+		int sp{};
+		float t{};
+		if (!nodes[0].box.intersect(r, inv_d, h.t, t))
+		{
+			return;
+		}
+		stack[sp++] = {0, t};
+		while (sp > 0)
+		{
+			auto [idx, tnear]{stack[--sp]};
+			visited++;
+			if (tnear > h.t)
+			{
+				continue;
+			}
+			const bvh_node& n{nodes[idx]};
+			if (n.count > 0)
+			{
+				for (int i{n.first}; i < n.first + n.count; i++)
+				{
+					hit_information hit{intersect(indices[i])};
+					if (hit.hits != 0 && hit.t < h.t)
+					{
+						h = hit;
+					}
+				}
+				continue;
+			}
+
+			// push the far child first so the near one is visited next
+			float tl{}, tr{};
+			bool hl{nodes[n.first].box.intersect(r, inv_d, h.t, tl)};
+			bool hr{nodes[n.first + 1].box.intersect(r, inv_d, h.t, tr)};
+			if (hl && hr)
+			{
+				if (tl <= tr)
+				{
+					stack[sp++] = {n.first + 1, tr};
+					stack[sp++] = {n.first, tl};
+				}
+				else
+				{
+					stack[sp++] = {n.first, tl};
+					stack[sp++] = {n.first + 1, tr};
+				}
+			}
+			else if (hl)
+			{
+				stack[sp++] = {n.first, tl};
+			}
+			else if (hr)
+			{
+				stack[sp++] = {n.first + 1, tr};
+			}
+		}
+	}
+
+	template <typename F>
+	bool any_binary(ray& r, float tmax, F&& occludes) const
+	{
+		if (nodes.empty())
+		{
+			return false;
+		}
+		glm::vec3 inv_d{1.0f / r.d};
+		int stack[max_depth + 2];
+		int sp{};
+		stack[sp++] = 0;
+		while (sp > 0)
+		{
+			const bvh_node& n{nodes[stack[--sp]]};
+			visited++;
+			float t{};
+			if (!n.box.intersect(r, inv_d, tmax, t))
+			{
+				continue;
+			}
+			if (n.count > 0)
+			{
+				for (int i{n.first}; i < n.first + n.count; i++)
+				{
+					if (occludes(indices[i]))
+					{
+						return true;
+					}
+				}
+				continue;
+			}
+			stack[sp++] = n.first + 1;
+			stack[sp++] = n.first;
+		}
+		return false;
+	}
+
+	// stack entries are wide nodes, or ~(node * 4 + lane) for a leaf lane whose primitives are still to be tested
+	template <typename F>
+	void closest_wide(ray& r, hit_information& h, F&& intersect) const
+	{
+		glm::vec3 inv_d{1.0f / r.d};
+		std::pair<int, float> stack[wide_stack];
+		int sp{};
+		stack[sp++] = {0, 0.0f};
+		while (sp > 0)
+		{
+			auto [entry, tnear]{stack[--sp]};
+			visited++;
+			if (tnear > h.t)
+			{
+				continue;
+			}
+			if (entry < 0)
+			{
+				const wide_node& leaf{wide_nodes[~entry / 4]};
+				int first{leaf.child[~entry % 4]};
+				for (int i{first}; i < first + leaf.count[~entry % 4]; i++)
+				{
+					hit_information hit{intersect(indices[i])};
+					if (hit.hits != 0 && hit.t < h.t)
+					{
+						h = hit;
+					}
+				}
+				continue;
+			}
+
+			// sort the hit lanes by entry distance and push the farthest first so the nearest is visited next
+			const wide_node& n{wide_nodes[entry]};
+			float t[4];
+			int mask{n.intersect(r.p, inv_d, h.t, t)};
+			int order[4];
+			int hits{};
+			for (int lane{}; lane < 4; lane++)
+			{
+				if (mask & (1 << lane))
+				{
+					int k{hits++};
+					for (; k > 0 && t[order[k - 1]] > t[lane]; k--)
+					{
+						order[k] = order[k - 1];
+					}
+					order[k] = lane;
+				}
+			}
+			for (int k{hits - 1}; k >= 0; k--)
+			{
+				int lane{order[k]};
+				stack[sp++] = {n.count[lane] > 0 ? ~(entry * 4 + lane) : n.child[lane], t[lane]};
+			}
+		}
+	}
+
+	template <typename F>
+	bool any_wide(ray& r, float tmax, F&& occludes) const
+	{
+		glm::vec3 inv_d{1.0f / r.d};
+		int stack[wide_stack];
+		int sp{};
+		stack[sp++] = 0;
+		while (sp > 0)
+		{
+			int entry{stack[--sp]};
+			visited++;
+			if (entry < 0)
+			{
+				const wide_node& leaf{wide_nodes[~entry / 4]};
+				int first{leaf.child[~entry % 4]};
+				for (int i{first}; i < first + leaf.count[~entry % 4]; i++)
+				{
+					if (occludes(indices[i]))
+					{
+						return true;
+					}
+				}
+				continue;
+			}
+			const wide_node& n{wide_nodes[entry]};
+			float t[4];
+			int mask{n.intersect(r.p, inv_d, tmax, t)};
+			for (int lane{3}; lane >= 0; lane--)
+			{
+				if (mask & (1 << lane))
+				{
+					stack[sp++] = n.count[lane] > 0 ? ~(entry * 4 + lane) : n.child[lane];
+				}
+			}
+		}
+		return false;
+	}
+
+private:
+	// primitives are partitioned as copies so every pass over a node reads contiguous memory
+	struct build_ref
+	{
+		aabb box{};
+		glm::vec3 center{};
+		int id{};
+	};
+	std::vector<build_ref> refs{};
+	std::vector<build_ref> scratch{}; // target of the parallel partition of a large node
+
+	float weight(const bvh_node& n) const
+	{
+		return n.count > 0 ? intersection_cost * n.count : traversal_cost;
+	}
+
+	// parent links, the leaf of every primitive and the sah cost of the current boxes
+	void link()
+	{
+		parents.assign(nodes.size(), -1);
+		int max_id{-1};
+		for (int id : indices)
+		{
+			max_id = std::max(max_id, id);
+		}
+		leaf_of.assign(max_id + 1, -1);
+		weighted_area = 0.0;
+		for (int i{}; i < nodes.size(); i++)
+		{
+			const bvh_node& n{nodes[i]};
+			weighted_area += weight(n) * n.box.area();
+			if (n.count > 0)
+			{
+				for (int k{n.first}; k < n.first + n.count; k++)
+				{
+					leaf_of[indices[k]] = i;
+				}
+			}
+			else
+			{
+				parents[n.first] = i;
+				parents[n.first + 1] = i;
+			}
+		}
+		built_cost = cost();
+	}
+
+	// rebuilds the wide nodes from the binary ones. every wide node takes the two children of a binary node
+	// and keeps opening its largest inner child until it has four lanes or only leaves left
+	void collapse()
+	{
+		wide_nodes.clear();
+		wide_slot.assign(nodes.size(), -1);
+		if (nodes.empty())
+		{
+			return;
+		}
+		wide_nodes.reserve(nodes.size() / 2 + 1);
+		wide_nodes.push_back(wide_node{});
+		collapse(0, 0);
+	}
+
+	void collapse(int wide, int node)
+	{
+		int lanes[4]{node};
+		int used{1};
+		if (nodes[node].count == 0)
+		{
+			lanes[0] = nodes[node].first;
+			lanes[1] = nodes[node].first + 1;
+			used = 2;
+		}
+		while (used < 4)
+		{
+			int open{-1};
+			for (int i{}; i < used; i++)
+			{
+				if (nodes[lanes[i]].count == 0 && (open < 0 || nodes[lanes[i]].box.area() > nodes[lanes[open]].box.area()))
+				{
+					open = i;
+				}
+			}
+			if (open < 0)
+			{
+				break;
+			}
+			int first{nodes[lanes[open]].first};
+			for (int i{used}; i > open + 1; i--)
+			{
+				lanes[i] = lanes[i - 1];
+			}
+			lanes[open] = first;
+			lanes[open + 1] = first + 1;
+			used++;
+		}
+
+		for (int i{}; i < used; i++)
+		{
+			const bvh_node& n{nodes[lanes[i]]};
+			wide_slot[lanes[i]] = wide * 4 + i;
+			wide_nodes[wide].set_box(i, n.box);
+			wide_nodes[wide].count[i] = n.count;
+			if (n.count > 0)
+			{
+				wide_nodes[wide].child[i] = n.first;
+			}
+			else
+			{
+				int child{static_cast<int>(wide_nodes.size())};
+				wide_nodes.push_back(wide_node{});
+				wide_nodes[wide].child[i] = child;
+				collapse(child, lanes[i]);
+			}
+		}
+		for (int i{used}; i < 4; i++)
+		{
+			wide_nodes[wide].set_box(i, aabb{});
+		}
+	}
+
+	struct split_result
+	{
+		aabb box{};
+		int left{-1}; // primitives that went to the left child, -1 makes the node a leaf
+	};
+
+	struct bins
+	{
+		aabb box[3][bin_count]{};
+		int count[3][bin_count]{};
+
+		void add(const bins& o)
+		{
+			for (int a{}; a < 3; a++)
+			{
+				for (int b{}; b < bin_count; b++)
+				{
+					box[a][b].grow(o.box[a][b]);
+					count[a][b] += o.count[a][b];
+				}
+			}
+		}
+	};
+
+	// maps centroids to bins along every axis with a non-zero extent, small nodes use fewer bins
+	struct binning
+	{
+		glm::vec3 min{};
+		glm::vec3 scale{};
+		int count{};
+
+		binning(const aabb& centroids, int primitives)
+			: min{centroids.min}
+			, count{std::clamp(primitives, 2, bin_count)}
+		{
+			glm::vec3 extent{centroids.max - centroids.min};
+			for (int a{}; a < 3; a++)
+			{
+				scale[a] = extent[a] > 0 ? count / extent[a] : 0.0f;
+			}
+		}
+
+		int operator()(int axis, glm::vec3 c) const
+		{
+			return std::clamp((int)((c[axis] - min[axis]) * scale[axis]), 0, count - 1);
+		}
+	};
+
+	void bounds(int first, int count, aabb& box, aabb& centroids) const
+	{
+		for (int i{first}; i < first + count; i++)
+		{
+			box.grow(refs[i].box);
+			centroids.grow(refs[i].center);
+		}
+	}
+
+	void bin(int first, int count, const binning& to_bin, bins& out) const
+	{
+		for (int i{first}; i < first + count; i++)
+		{
+			for (int a{}; a < 3; a++)
+			{
+				int k{to_bin(a, refs[i].center)};
+				out.box[a][k].grow(refs[i].box);
+				out.count[a][k]++;
+			}
+		}
+	}
+
+	// binned sah split of indices[first, first + count), the pool splits the bounds, binning and partition passes into chunks
+	split_result split(int first, int count, int depth, thread_pool* pool)
+	{
+		split_result r{};
+		aabb centroids{};
+		bool parallel{pool && pool->size() > 1 && count >= parallel_threshold};
+		int chunks{parallel ? pool->size() * 4 : 1};
+		if (parallel)
+		{
+			std::vector<aabb> chunk_box(chunks);
+			std::vector<aabb> chunk_centroids(chunks);
+			pool->run(chunks, [&](int c, int)
+			{
+				int b{first + (int)((long long)count * c / chunks)};
+				int e{first + (int)((long long)count * (c + 1) / chunks)};
+				bounds(b, e - b, chunk_box[c], chunk_centroids[c]);
+			});
+			for (int c{}; c < chunks; c++)
+			{
+				r.box.grow(chunk_box[c]);
+				centroids.grow(chunk_centroids[c]);
+			}
+		}
+		else
+		{
+			bounds(first, count, r.box, centroids);
+		}
+
+		float parent_area{r.box.area()};
+		if (count <= 1 || depth >= max_depth || parent_area <= 0)
+		{
+			return r;
+		}
+
+		binning to_bin{centroids, count};
+		bins total{};
+		if (parallel)
+		{
+			std::vector<bins> chunk_bins(chunks);
+			pool->run(chunks, [&](int c, int)
+			{
+				int b{first + (int)((long long)count * c / chunks)};
+				int e{first + (int)((long long)count * (c + 1) / chunks)};
+				bin(b, e - b, to_bin, chunk_bins[c]);
+			});
+			for (const bins& b : chunk_bins)
+			{
+				total.add(b);
+			}
+		}
+		else
+		{
+			bin(first, count, to_bin, total);
+		}
+
+		// sweep the bin boundaries of every axis and keep the cheapest split
+		float best_cost{intersection_cost * count};
+		int best_axis{-1};
+		int best_bin{};
+		for (int a{}; a < 3; a++)
+		{
+			if (centroids.max[a] <= centroids.min[a])
+			{
+				continue;
+			}
+			float right_area[bin_count]{};
+			int right_count[bin_count]{};
+			aabb right{};
+			int n{};
+			for (int b{to_bin.count - 1}; b > 0; b--)
+			{
+				right.grow(total.box[a][b]);
+				n += total.count[a][b];
+				right_area[b] = right.area();
+				right_count[b] = n;
+			}
+			aabb left{};
+			n = 0;
+			for (int b{1}; b < to_bin.count; b++)
+			{
+				left.grow(total.box[a][b - 1]);
+				n += total.count[a][b - 1];
+				if (n == 0 || right_count[b] == 0)
+				{
+					continue;
+				}
+				float cost{traversal_cost + intersection_cost * (left.area() * n + right_area[b] * right_count[b]) / parent_area};
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = a;
+					best_bin = b;
+				}
+			}
+		}
+		if (best_axis == -1)
+		{
+			return r;
+		}
+
+		auto goes_left{[&](const build_ref& ref)
+		{
+			return to_bin(best_axis, ref.center) < best_bin;
+		}};
+		if (!parallel)
+		{
+			auto mid{std::partition(refs.begin() + first, refs.begin() + first + count, goes_left)};
+			r.left = mid - (refs.begin() + first);
+			return r;
+		}
+
+		// every chunk counts its left references, the prefix sums of the counts give each chunk the place
+		// of its left and right references in scratch, which is copied back in chunks as well
+		auto chunk_range{[&](int c)
+		{
+			return std::pair<int, int>{first + (int)((long long)count * c / chunks), first + (int)((long long)count * (c + 1) / chunks)};
+		}};
+		std::vector<int> chunk_left(chunks);
+		pool->run(chunks, [&](int c, int)
+		{
+			auto [b, e]{chunk_range(c)};
+			chunk_left[c] = std::count_if(refs.begin() + b, refs.begin() + e, goes_left);
+		});
+		std::vector<int> left_at(chunks);
+		std::vector<int> right_at(chunks);
+		int left{first};
+		for (int c{}; c < chunks; c++)
+		{
+			left_at[c] = left;
+			left += chunk_left[c];
+		}
+		int right{left};
+		for (int c{}; c < chunks; c++)
+		{
+			auto [b, e]{chunk_range(c)};
+			right_at[c] = right;
+			right += e - b - chunk_left[c];
+		}
+		scratch.resize(refs.size());
+		pool->run(chunks, [&](int c, int)
+		{
+			auto [b, e]{chunk_range(c)};
+			for (int i{b}; i < e; i++)
+			{
+				scratch[goes_left(refs[i]) ? left_at[c]++ : right_at[c]++] = refs[i];
+			}
+		});
+		pool->run(chunks, [&](int c, int)
+		{
+			auto [b, e]{chunk_range(c)};
+			std::copy(scratch.begin() + b, scratch.begin() + e, refs.begin() + b);
+		});
+		r.left = left - first;
+		return r;
+	}
+
+	// builds the subtree of indices[first, first + count) into out, node is its slot in out
+	void subdivide(std::vector<bvh_node>& out, int node, int first, int count, int depth)
+	{
+		split_result r{split(first, count, depth, nullptr)};
+		if (r.left < 0)
+		{
+			out[node] = bvh_node{r.box, first, count};
+			return;
+		}
+		int child{static_cast<int>(out.size())};
+		out.push_back(bvh_node{});
+		out.push_back(bvh_node{});
+		out[node] = bvh_node{r.box, child, 0};
+		subdivide(out, child, first, r.left, depth + 1);
+		subdivide(out, child + 1, first + r.left, count - r.left, depth + 1);
+	}
+};
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <vector>
+#include <cstddef>
+
+// contiguous array that either owns its elements or views external memory such as a mapped snapshot,
+// element writes go straight to the viewed memory and anything that changes the size copies it first
+template <typename T>
+struct column
+{
+	std::vector<T> owned{};
+	T* ptr{nullptr};
+	size_t n{};
+
+	column()
+	{
+	}
+
+	column(const column& o)
+		: owned(o.ptr, o.ptr + o.n)
+	{
+		sync();
+	}
+
+	column(column&& o)
+		: owned(std::move(o.owned))
+		, ptr{o.ptr}
+		, n{o.n}
+	{
+		o.ptr = nullptr;
+		o.n = 0;
+		if (!owned.empty())
+		{
+			sync();
+		}
+	}
+
+	column& operator=(const column& o)
+	{
+		if (this != &o)
+		{
+			owned.assign(o.ptr, o.ptr + o.n);
+			sync();
+		}
+		return *this;
+	}
+
+	column& operator=(column&& o)
+	{
+		if (this != &o)
+		{
+			owned = std::move(o.owned);
+			ptr = o.ptr;
+			n = o.n;
+			o.ptr = nullptr;
+			o.n = 0;
+			if (!owned.empty())
+			{
+				sync();
+			}
+		}
+		return *this;
+	}
+
+	column& operator=(const std::vector<T>& v)
+	{
+		owned = v;
+		sync();
+		return *this;
+	}
+
+	// the memory has to outlive the column or the next size change
+	void attach(T* data, size_t count)
+	{
+		owned.clear();
+		owned.shrink_to_fit();
+		ptr = data;
+		n = count;
+	}
+
+	bool viewing() const
+	{
+		return n > 0 && ptr != owned.data();
+	}
+
+	size_t size() const
+	{
+		return n;
+	}
+
+	bool empty() const
+	{
+		return n == 0;
+	}
+
+	T* data()
+	{
+		return ptr;
+	}
+
+	const T* data() const
+	{
+		return ptr;
+	}
+
+	T& operator[](size_t i)
+	{
+		return ptr[i];
+	}
+
+	const T& operator[](size_t i) const
+	{
+		return ptr[i];
+	}
+
+	T* begin()
+	{
+		return ptr;
+	}
+
+	T* end()
+	{
+		return ptr + n;
+	}
+
+	const T* begin() const
+	{
+		return ptr;
+	}
+
+	const T* end() const
+	{
+		return ptr + n;
+	}
+
+	T& back()
+	{
+		return ptr[n - 1];
+	}
+
+	void push_back(const T& v)
+	{
+		own();
+		owned.push_back(v);
+		sync();
+	}
+
+	void pop_back()
+	{
+		own();
+		owned.pop_back();
+		sync();
+	}
+
+	void resize(size_t count)
+	{
+		if (count == n)
+		{
+			return;
+		}
+		own();
+		owned.resize(count);
+		sync();
+	}
+
+	void reserve(size_t count)
+	{
+		own();
+		owned.reserve(count);
+		sync();
+	}
+
+	void clear()
+	{
+		owned.clear();
+		sync();
+	}
+
+private:
+	void own()
+	{
+		if (viewing())
+		{
+			owned.assign(ptr, ptr + n);
+		}
+	}
+
+	void sync()
+	{
+		ptr = owned.data();
+		n = owned.size();
+	}
+};
+
+#endif
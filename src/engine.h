@@ -39,176 +39,110 @@ struct camera
 
 	float d{5.0f};
 
-	ray viewing_ray{};
-
 	bool ortho{false};
 
-	ray& generate_ray(int i, int j)
+	// returns by value so rays can be generated from several threads at once
+	ray generate_ray(int i, int j) const
 	{
 		if (ortho)
 		{
-			generate_ray_orthographic(i, j);
-		}
-		else
-		{
-			generate_ray_perspective(i, j);
+			return generate_ray_orthographic(i, j);
 		}
-		return viewing_ray;
+		return generate_ray_perspective(i, j);
 	}
 
-	void generate_ray_orthographic(int i, int j)
+	ray generate_ray_orthographic(int i, int j) const
 	{
 		float coord_u = l + (r - l) * (i + 0.5) / nx;
 		float coord_v = b + (t - b) * (j + 0.5) / ny;
 
-		viewing_ray.p = e + (u * coord_u) + (coord_v * v);
-		viewing_ray.d = -w;
+		return ray{e + (u * coord_u) + (coord_v * v), -w};
 	}
 
-	void generate_ray_perspective(int i, int j)
+	ray generate_ray_perspective(int i, int j) const
 	{
 		float coord_u = l + (r - l) * (i + 0.5) / nx;
 		float coord_v = b + (t - b) * (j + 0.5) / ny;
 
-		viewing_ray.p = e;
-		viewing_ray.d = glm::normalize(-d * w + (u * coord_u) + (coord_v * v));
+		return ray{e, glm::normalize(-d * w + (u * coord_u) + (coord_v * v))};
 	}
 
 	void toggle_cam()
 	{
 		ortho = !ortho;
 	}
-};
-
-struct surface;
-
-struct hit_information
-{
-	surface* s{nullptr};
-	int hits{};
-
-	float t{INF};
-	glm::vec3 normal{};
-
-};
 
-struct material
-{
-	// float k_a{1.0};
-	float k_a{0.1};
-	float k_d{0.8};
-	float k_s{0.3};
-	int p{8};
-	bool glazed{false};
+	bool operator==(const camera&) const = default;
 };
 
-struct surface
+struct aabb
 {
-	bool visible{true};
-	glm::vec3 color{1.0f, 0.0f, 0.0f};
-	material* m{};
-	int mat_idx{};
-	glm::vec3 center{};
-	float r{1.0f};
-
-	virtual hit_information intersect(ray& view_ray) = 0;	
-};
+	glm::vec3 min{INF, INF, INF};
+	glm::vec3 max{-INF, -INF, -INF};
 
-struct sphere : public surface
-{
-	sphere()
+	void grow(glm::vec3 p)
 	{
+		min = glm::min(min, p);
+		max = glm::max(max, p);
 	}
 
-	hit_information intersect(ray& view_ray)
+	void grow(const aabb& b)
 	{
-		hit_information i{};
-		i.s = this;
-		glm::vec3 ec{view_ray.p-center};
-		float dd{glm::dot(view_ray.d, view_ray.d)};
-		float discriminant = glm::pow(glm::dot(view_ray.d, ec), 2) - dd * (glm::dot(ec, ec) - glm::pow(r, 2));
-		if (discriminant >= 0) // at least one solutions
-		{
-			// ray goes through object
-			i.t = glm::min((glm::dot(-view_ray.d, ec) - glm::sqrt(discriminant)) / dd, (glm::dot(-view_ray.d, ec) + glm::sqrt(discriminant)) / dd);
-			if (i.t < 0)
-			{
-				return i;
-			}
-			i.normal = (view_ray.evaluate(i.t)-center)/r;
-			i.hits = 2;
-
-			if (discriminant == 0) // one solution
-			{
-				// ray is tangent to object
-				i.hits = 1;
-			}
-		}
-
-		// if ray misses object, do nothing
-
-		return i;
+		min = glm::min(min, b.min);
+		max = glm::max(max, b.max);
 	}
-};
-
-struct triangle : public surface
-{
-	glm::vec3 p1{-1, 0, -1};
-	glm::vec3 p2{-1, 0, 1};
-	glm::vec3 p3{1, 0, 1};
-	// glm::vec3 p1{-5, 0, -5};
-	// glm::vec3 p2{-5, 0, 5};
-	// glm::vec3 p3{5, 0, 5};
-
-	bool plane{false};
 
-	triangle()
+	glm::vec3 centroid() const
 	{
+		return (min + max) * 0.5f;
 	}
 
-	triangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
-		: p1{p1}
-		, p2{p2}
-		, p3{p3}
+	float area() const
 	{
+		glm::vec3 e{max - min};
+		if (e.x < 0 || e.y < 0 || e.z < 0)
+		{
+			return 0.0f;
+		}
+		return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
 	}
 
-	void move(glm::vec3 pos)
+	bool operator==(const aabb&) const = default;
+
+	// slab test, tnear is the entry distance when the box is hit before tmax
+	bool intersect(const ray& r, glm::vec3 inv_d, float tmax, float& tnear) const
 	{
-		p1+=pos;
-		p2+=pos;
-		p3+=pos;
+		glm::vec3 t0{(min - r.p) * inv_d};
+		glm::vec3 t1{(max - r.p) * inv_d};
+		glm::vec3 lo{glm::min(t0, t1)};
+		glm::vec3 hi{glm::max(t0, t1)};
+		tnear = glm::max(glm::max(lo.x, lo.y), lo.z);
+		float tfar{glm::min(glm::min(hi.x, hi.y), glm::min(hi.z, tmax))};
+		return tnear <= tfar && tfar >= 0;
 	}
+};
 
-	hit_information intersect(ray& view_ray)
-	{
-		hit_information h{};
-		h.s=this;
-		glm::vec3 normal{glm::normalize(glm::cross(p2-p1,p3-p1))};
+struct hit_information
+{
+	int obj{-1}; // object id in the geometry store
+	int prim{-1}; // triangle within the mesh when obj is an instance
+	int hits{};
+
+	float t{INF};
+	glm::vec3 normal{};
 
+};
 
-		h.t=glm::dot(p1-view_ray.p, normal)/glm::dot(normal, view_ray.d);
-		if (h.t < 0)
-		{
-			return h;
-		}
-		glm::vec3 x{view_ray.evaluate(h.t)};
-		float e1{glm::dot(glm::cross(p2-p1, x-p1), normal)};
-		float e2{glm::dot(glm::cross(p3-p2, x-p2), normal)};
-		float e3{glm::dot(glm::cross(p1-p3, x-p3), normal)};
-
-		// if (e1 <= 0 || e2 <= 0 || e3 <= 0)
-		// {
-		// 	return h;
-		// }
-		if ((e1 > 0 && e2 > 0 && e3 > 0) || plane)
-		{
-			h.normal=normal;
-			h.hits=1;
-		}
+struct material
+{
+	// float k_a{1.0};
+	float k_a{0.1};
+	float k_d{0.8};
+	float k_s{0.3};
+	int p{8};
+	bool glazed{false};
 
-		return h;
-	}
+	bool operator==(const material&) const = default;
 };
 
 struct light
@@ -216,14 +150,18 @@ struct light
 	glm::vec3 color{1.0f, 1.0f, 1.0f};
 	bool visible{true};
 	// virtual glm::vec3 illuminate(ray& r, hit_information& hit);
+
+	bool operator==(const light&) const = default;
 };
 
 struct ambient_light : public light
 {
-	glm::vec3 illuminate(ray& r, hit_information& hit)
+	glm::vec3 illuminate(const material& m, glm::vec3 albedo)
 	{
-		return hit.s->m->k_a * hit.s->color * color;
+		return m.k_a * albedo * color;
 	}
+
+	bool operator==(const ambient_light&) const = default;
 };
 
 struct point_light : public light
@@ -251,36 +189,38 @@ struct point_light : public light
 	{
 	}
 
-	glm::vec3 illuminate(ray& r, hit_information& hit, std::vector<surface*>& scene, bool& blinn_phong)
+	bool operator==(const point_light&) const = default;
+
+	// ray from the hit towards the light, only occluders closer than tmax lie between the point and the light
+	ray shadow_ray(ray& r, const hit_information& hit, float& tmax) const
 	{
-		if (!visible)
-		{
-			return glm::vec3{0, 0, 0};
-		}
 		glm::vec3 x{r.evaluate(hit.t)};
 		float dist{glm::length(p - x)};
 		glm::vec3 l{(p-x)/dist}; // normalized ray pointing to light
-		ray light_ray{x+0.01f*l, l};
-		hit_information h;
-		for (auto& obj : scene)
-		{
-			if (hit.s == obj || obj->visible==false)
-			{
-				continue;
-			}
-
+		tmax = dist-0.01f;
+		return ray{x+0.01f*l, l};
+	}
 
-			h = obj->intersect(light_ray);
+	// occluded(ray, tmax, from) answers the shadow query, so any acceleration structure can be used
+	template <typename F>
+	glm::vec3 illuminate(ray& r, hit_information& hit, const material& m, glm::vec3 albedo, F&& occluded, bool& blinn_phong)
+	{
+		if (!visible)
+		{
+			return glm::vec3{0, 0, 0};
+		}
+		float tmax{};
+		ray light_ray{shadow_ray(r, hit, tmax)};
+		glm::vec3 l{light_ray.d};
 
-			// shadows
-			if (h.hits != 0)
-			{
-				return glm::vec3{0, 0, 0};
-			}
+		// shadows
+		if (occluded(light_ray, tmax, hit))
+		{
+			return glm::vec3{0, 0, 0};
 		}
 		glm::vec3 E{glm::max(0.0f,glm::dot(hit.normal,l)) * color}; // /(float)glm::pow(dist,2)
 
-		glm::vec3 Ld = hit.s->m->k_d*hit.s->color*E;
+		glm::vec3 Ld = m.k_d*albedo*E;
 
 		// phong model
 		glm::vec3 Ls{};
@@ -288,15 +228,34 @@ struct point_light : public light
 		{
 			glm::vec3 vR{-glm::normalize(2*glm::dot(hit.normal, l)*hit.normal-l)};
 			glm::vec3 vE{r.d};
-			Ls = hit.s->m->k_s*color*(float)glm::pow(glm::max(0.0f, glm::dot(vE, vR)), hit.s->m->p);
+			Ls = m.k_s*color*(float)glm::pow(glm::max(0.0f, glm::dot(vE, vR)), m.p);
 		}
 		else
 		{
 			glm::vec3 v2{glm::normalize(l-r.d)};
-			Ls = hit.s->m->k_s*(float)glm::pow(glm::max(0.0f,glm::dot(hit.normal,v2)), hit.s->m->p)*E*color;
+			Ls = m.k_s*(float)glm::pow(glm::max(0.0f,glm::dot(hit.normal,v2)), m.p)*E*color;
 		}
 		return Ld+Ls;
 	}
+
+	// the terms of illuminate for an unshadowed light in direction l with the color of the light factored out,
+	// the light adds linear * color + quadratic * color * color since blinn phong scales E by the color again
+	void response(const ray& r, const hit_information& hit, glm::vec3 l, const material& m, glm::vec3 albedo, bool blinn_phong, glm::vec3& linear, glm::vec3& quadratic) const
+	{
+		float cos_l{glm::max(0.0f, glm::dot(hit.normal, l))};
+		linear = m.k_d*albedo*cos_l;
+		quadratic = glm::vec3{0, 0, 0};
+		if (!blinn_phong)
+		{
+			glm::vec3 vR{-glm::normalize(2*glm::dot(hit.normal, l)*hit.normal-l)};
+			linear += glm::vec3{m.k_s*(float)glm::pow(glm::max(0.0f, glm::dot(r.d, vR)), m.p)};
+		}
+		else
+		{
+			glm::vec3 v2{glm::normalize(l-r.d)};
+			quadratic = glm::vec3{m.k_s*(float)glm::pow(glm::max(0.0f,glm::dot(hit.normal,v2)), m.p)*cos_l};
+		}
+	}
 };
 
 #endif
\ No newline at end of file
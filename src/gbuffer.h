@@ -0,0 +1,115 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <vector>
+#include <algorithm>
+
+#include "engine.h"
+#include "column.h"
+
+// everything shading the cached hits depends on apart from the point lights, materials, object colors
+// and ambient lights are represented by the version counter that their edits bump
+struct shading_key
+{
+	unsigned hits_version{};
+	unsigned shading_version{};
+	size_t pixels{};
+	size_t lights{};
+	bool blinn_phong{};
+	int bounce_count{};
+	float min_throughput{};
+
+	bool operator==(const shading_key&) const = default;
+};
+
+// primary ray and closest hit of every pixel, the hit position is the ray evaluated at the hit distance.
+// while the camera, resolution, geometry and visibility stay the same an edit of materials or lights
+// only has to shade these hits again, the shadow bits of a point light are kept as long as it stays in place
+struct gbuffer
+{
+	std::vector<ray> rays{};
+	std::vector<hit_information> hits{};
+	std::vector<unsigned> shadowed{}; // pixel * lights + light, 1 when the light is occluded
+
+	int width{};
+	int height{};
+	camera cam{};
+	std::vector<unsigned char> visible{};
+
+	// step of the pass whose blocks are all stored, 1 once every pixel is, 0 when nothing is stored
+	int coverage{};
+	// counts the invalidations so data derived from the hits knows when it is outdated
+	unsigned version{};
+
+	// point lights the shadow bits were traced for
+	std::vector<point_light> lights{};
+	bool shadows_valid{false};
+
+	// settings and lights the whole image was last shaded with from these hits, while they stay
+	// the same a moved object only changes the pixels it can reach
+	shading_key shaded{};
+	std::vector<point_light> shaded_lights{};
+	bool image_shaded{false};
+
+	void invalidate()
+	{
+		coverage = 0;
+		shadows_valid = false;
+		image_shaded = false;
+		version++;
+	}
+
+	void shade(const shading_key& key, const std::vector<point_light>& point_lights)
+	{
+		shaded = key;
+		shaded_lights = point_lights;
+		image_shaded = true;
+	}
+
+	bool matches(int w, int h, const camera& c, const column<unsigned char>& v) const
+	{
+		return width == w && height == h && cam == c && std::equal(visible.begin(), visible.end(), v.begin(), v.end());
+	}
+
+	bool complete(int w, int h, const camera& c, const column<unsigned char>& v) const
+	{
+		return coverage == 1 && matches(w, h, c, v);
+	}
+
+	// called before a pass stores its hits, a different view starts over
+	void begin(int w, int h, const camera& c, const column<unsigned char>& v)
+	{
+		if (!matches(w, h, c, v))
+		{
+			width = w;
+			height = h;
+			cam = c;
+			visible.assign(v.begin(), v.end());
+			rays.resize((size_t)w * h);
+			hits.resize((size_t)w * h);
+			invalidate();
+		}
+		shadows_valid = false;
+		image_shaded = false;
+	}
+
+	void store(int x, int y, const ray& r, const hit_information& hit)
+	{
+		rays[(size_t)y * width + x] = r;
+		hits[(size_t)y * width + x] = hit;
+	}
+
+	// a refining pass completes the coverage of the twice as coarse pass before it
+	void rendered(int step, bool refine)
+	{
+		coverage = !refine ? step : coverage == 2 * step ? step : 0;
+	}
+
+	// whether the shadow bits of light l still hold, the bits are laid out for the number of lights they were traced for
+	bool shadow_valid(const std::vector<point_light>& point_lights, size_t l) const
+	{
+		return shadows_valid && lights.size() == point_lights.size() && lights[l].p == point_lights[l].p && lights[l].visible == point_lights[l].visible;
+	}
+};
+
+#endif
@@ -0,0 +1,593 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "engine.h"
+#include "column.h"
+#include "bvh.h"
+
+enum class shape : unsigned char
+{
+	sphere,
+	triangle,
+	instance
+};
+
+// moller-trumbore with strict bounds, shared by scene and mesh triangles
+inline bool moller_trumbore(glm::vec3 p1, glm::vec3 e1, glm::vec3 e2, const ray& view_ray, float& t)
+{
+	glm::vec3 tvec{view_ray.p-p1};
+	glm::vec3 pvec{glm::cross(view_ray.d, e2)};
+	float det{glm::dot(e1, pvec)};
+	if (det == 0)
+	{
+		return false;
+	}
+	float inv_det{1.0f/det};
+	float u{glm::dot(tvec, pvec)*inv_det};
+	if (u <= 0 || u >= 1)
+	{
+		return false;
+	}
+	glm::vec3 qvec{glm::cross(tvec, e1)};
+	float v{glm::dot(view_ray.d, qvec)*inv_det};
+	if (v <= 0 || u+v >= 1)
+	{
+		return false;
+	}
+	t=glm::dot(e2, qvec)*inv_det;
+	return t >= 0;
+}
+
+// scene geometry as structure of arrays, objects are referenced by id and intersected without virtual calls,
+// every array is a column so a mapped snapshot can be used in place.
+// instances place a shared mesh with an affine transform, so a mesh used many times is stored and built once
+struct geometry_store
+{
+	// per object, in scene order
+	column<shape> kind{};
+	column<int> index{}; // into the sphere or triangle arrays
+	column<int> mat{};
+	column<glm::vec3> color{};
+	column<unsigned char> visible{};
+
+	// spheres
+	column<glm::vec3> sphere_center{};
+	column<float> sphere_radius{};
+	column<int> sphere_object{};
+
+	// triangles, plane triangles extend to the infinite plane through their vertices
+	column<glm::vec3> tri_p1{};
+	column<glm::vec3> tri_p2{};
+	column<glm::vec3> tri_p3{};
+	column<unsigned char> tri_plane{};
+	column<int> tri_object{};
+
+	// filled by prepare(), the kernels only read these and tri_p1
+	column<glm::vec3> tri_e1{};
+	column<glm::vec3> tri_e2{};
+	column<glm::vec3> tri_normal{};
+
+	// meshes are ranges of object space triangles with a default material and color for their instances
+	column<int> mesh_first{};
+	column<int> mesh_count{};
+	column<int> mesh_mat{};
+	column<glm::vec3> mesh_color{};
+	column<glm::vec3> mesh_p1{};
+	column<glm::vec3> mesh_p2{};
+	column<glm::vec3> mesh_p3{};
+
+	// filled by prepare() for meshes without a bottom level bvh, which is over triangles local to the mesh
+	column<glm::vec3> mesh_e1{};
+	column<glm::vec3> mesh_e2{};
+	column<glm::vec3> mesh_normal{};
+	std::vector<bvh> mesh_bvh{};
+
+	// instances, the mat and color of the instance object override the mesh defaults
+	column<int> inst_mesh{};
+	column<glm::mat4> inst_transform{}; // object to world
+	column<glm::mat4> inst_inverse{}; // world to object, filled by prepare()
+	column<int> inst_object{};
+
+	// set after objects are added or removed so commit() prepares everything and rebuilds
+	bool dirty{true};
+
+	// objects whose position or size changed since the last commit, prepared and refitted one by one
+	std::vector<int> moved{};
+
+	int size() const
+	{
+		return kind.size();
+	}
+
+	void touch(int obj)
+	{
+		moved.push_back(obj);
+	}
+
+	int add_sphere(glm::vec3 center, float r, int m, glm::vec3 c=glm::vec3{1.0f, 0.0f, 0.0f})
+	{
+		int obj{add_object(shape::sphere, sphere_center.size(), m, c)};
+		sphere_center.push_back(center);
+		sphere_radius.push_back(r);
+		sphere_object.push_back(obj);
+		return obj;
+	}
+
+	int add_triangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, int m, glm::vec3 c=glm::vec3{1.0f, 0.0f, 0.0f}, bool plane=false)
+	{
+		int obj{add_object(shape::triangle, tri_p1.size(), m, c)};
+		tri_p1.push_back(p1);
+		tri_p2.push_back(p2);
+		tri_p3.push_back(p3);
+		tri_plane.push_back(plane);
+		tri_object.push_back(obj);
+		return obj;
+	}
+
+	// starts an empty mesh, add_mesh_triangle appends to the last one
+	int add_mesh(int m, glm::vec3 c=glm::vec3{1.0f, 0.0f, 0.0f})
+	{
+		dirty = true;
+		mesh_first.push_back(mesh_p1.size());
+		mesh_count.push_back(0);
+		mesh_mat.push_back(m);
+		mesh_color.push_back(c);
+		mesh_bvh.emplace_back();
+		return mesh_first.size() - 1;
+	}
+
+	void add_mesh_triangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
+	{
+		dirty = true;
+		mesh_p1.push_back(p1);
+		mesh_p2.push_back(p2);
+		mesh_p3.push_back(p3);
+		mesh_count.back()++;
+		mesh_bvh.back() = bvh{};
+	}
+
+	// the instance takes the material and color of its mesh until they are overridden
+	int add_instance(int mesh, const glm::mat4& transform)
+	{
+		int obj{add_object(shape::instance, inst_mesh.size(), mesh_mat[mesh], mesh_color[mesh])};
+		inst_mesh.push_back(mesh);
+		inst_transform.push_back(transform);
+		inst_inverse.push_back(glm::inverse(transform));
+		inst_object.push_back(obj);
+		return obj;
+	}
+
+	int meshes() const
+	{
+		return mesh_first.size();
+	}
+
+	// caches edges and unit normals, run after triangles are added or edited. meshes are only prepared
+	// and built once, instances only need the inverse of their transform
+	void prepare()
+	{
+		tri_e1.resize(tri_p1.size());
+		tri_e2.resize(tri_p1.size());
+		tri_normal.resize(tri_p1.size());
+		for (int i{}; i < tri_p1.size(); i++)
+		{
+			prepare(i);
+		}
+
+		mesh_e1.resize(mesh_p1.size());
+		mesh_e2.resize(mesh_p1.size());
+		mesh_normal.resize(mesh_p1.size());
+		for (int m{}; m < meshes(); m++)
+		{
+			if (mesh_bvh[m].empty() && mesh_count[m] > 0)
+			{
+				prepare_mesh(m);
+			}
+		}
+
+		inst_inverse.resize(inst_mesh.size());
+		for (int i{}; i < inst_mesh.size(); i++)
+		{
+			prepare_instance(i);
+		}
+	}
+
+	void prepare(int tri)
+	{
+		tri_e1[tri] = tri_p2[tri] - tri_p1[tri];
+		tri_e2[tri] = tri_p3[tri] - tri_p1[tri];
+		tri_normal[tri] = glm::normalize(glm::cross(tri_e1[tri], tri_e2[tri]));
+	}
+
+	void prepare_mesh(int m)
+	{
+		int first{mesh_first[m]};
+		std::vector<aabb> boxes(mesh_count[m]);
+		std::vector<int> prims(mesh_count[m]);
+		for (int i{}; i < mesh_count[m]; i++)
+		{
+			int t{first + i};
+			mesh_e1[t] = mesh_p2[t] - mesh_p1[t];
+			mesh_e2[t] = mesh_p3[t] - mesh_p1[t];
+			mesh_normal[t] = glm::normalize(glm::cross(mesh_e1[t], mesh_e2[t]));
+			boxes[i].grow(mesh_p1[t]);
+			boxes[i].grow(mesh_p2[t]);
+			boxes[i].grow(mesh_p3[t]);
+			prims[i] = i;
+		}
+		mesh_bvh[m].build(boxes, prims);
+	}
+
+	void prepare_instance(int inst)
+	{
+		inst_inverse[inst] = glm::inverse(inst_transform[inst]);
+	}
+
+	// prepares a single object after it was moved
+	void prepare_object(int obj)
+	{
+		if (kind[obj] == shape::triangle)
+		{
+			prepare(index[obj]);
+		}
+		else if (kind[obj] == shape::instance)
+		{
+			prepare_instance(index[obj]);
+		}
+	}
+
+	// the last object is always the last of its shape
+	void pop_back()
+	{
+		if (kind.empty())
+		{
+			return;
+		}
+		if (kind.back() == shape::sphere)
+		{
+			sphere_center.pop_back();
+			sphere_radius.pop_back();
+			sphere_object.pop_back();
+		}
+		else if (kind.back() == shape::instance)
+		{
+			inst_mesh.pop_back();
+			inst_transform.pop_back();
+			inst_inverse.pop_back();
+			inst_object.pop_back();
+		}
+		else
+		{
+			tri_p1.pop_back();
+			tri_p2.pop_back();
+			tri_p3.pop_back();
+			tri_plane.pop_back();
+			tri_object.pop_back();
+		}
+		dirty = true;
+		kind.pop_back();
+		index.pop_back();
+		mat.pop_back();
+		color.pop_back();
+		visible.pop_back();
+	}
+
+	void clear()
+	{
+		kind.clear();
+		index.clear();
+		mat.clear();
+		color.clear();
+		visible.clear();
+		sphere_center.clear();
+		sphere_radius.clear();
+		sphere_object.clear();
+		tri_p1.clear();
+		tri_p2.clear();
+		tri_p3.clear();
+		tri_plane.clear();
+		tri_object.clear();
+		tri_e1.clear();
+		tri_e2.clear();
+		tri_normal.clear();
+		mesh_first.clear();
+		mesh_count.clear();
+		mesh_mat.clear();
+		mesh_color.clear();
+		mesh_p1.clear();
+		mesh_p2.clear();
+		mesh_p3.clear();
+		mesh_e1.clear();
+		mesh_e2.clear();
+		mesh_normal.clear();
+		mesh_bvh.clear();
+		inst_mesh.clear();
+		inst_transform.clear();
+		inst_inverse.clear();
+		inst_object.clear();
+		moved.clear();
+		dirty = true;
+	}
+
+	// unbounded objects (infinite planes) are kept out of the bvh, so are instances of empty meshes
+	bool bounded(int obj) const
+	{
+		if (kind[obj] == shape::instance)
+		{
+			return !mesh_bvh[inst_mesh[index[obj]]].empty();
+		}
+		return kind[obj] == shape::sphere || !tri_plane[index[obj]];
+	}
+
+	aabb bounds(int obj) const
+	{
+		int i{index[obj]};
+		aabb b{};
+		if (kind[obj] == shape::sphere)
+		{
+			glm::vec3 e{glm::abs(sphere_radius[i])};
+			b.grow(sphere_center[i] - e);
+			b.grow(sphere_center[i] + e);
+		}
+		else if (kind[obj] == shape::instance)
+		{
+			// the eight corners of the mesh root box in world space
+			aabb local{mesh_bvh[inst_mesh[i]].nodes[0].box};
+			for (int c{}; c < 8; c++)
+			{
+				glm::vec3 corner{c & 1 ? local.max.x : local.min.x, c & 2 ? local.max.y : local.min.y, c & 4 ? local.max.z : local.min.z};
+				b.grow(glm::vec3{inst_transform[i] * glm::vec4{corner, 1.0f}});
+			}
+		}
+		else
+		{
+			b.grow(tri_p1[i]);
+			b.grow(tri_p2[i]);
+			b.grow(tri_p3[i]);
+		}
+		return b;
+	}
+
+	hit_information intersect(int obj, ray& r) const
+	{
+		if (kind[obj] == shape::sphere)
+		{
+			return intersect_sphere(index[obj], r);
+		}
+		if (kind[obj] == shape::instance)
+		{
+			return intersect_instance(index[obj], r);
+		}
+		return intersect_triangle(index[obj], r);
+	}
+
+	// from is the surface the shadow ray leaves, it never shadows itself
+	bool occludes(int obj, ray& r, float tmax, const hit_information& from) const
+	{
+		if (kind[obj] == shape::instance)
+		{
+			return occludes_instance(index[obj], r, tmax, obj == from.obj ? from.prim : -1);
+		}
+		if (obj == from.obj)
+		{
+			return false;
+		}
+		if (kind[obj] == shape::sphere)
+		{
+			return occludes_sphere(index[obj], r, tmax);
+		}
+		return occludes_triangle(index[obj], r, tmax);
+	}
+
+	// linear scan of both shape arrays, used when the bvh is switched off
+	void closest(ray& r, hit_information& h) const
+	{
+		for (int i{}; i < sphere_center.size(); i++)
+		{
+			if (!visible[sphere_object[i]])
+			{
+				continue;
+			}
+			hit_information hit{intersect_sphere(i, r)};
+			if (hit.hits != 0 && hit.t < h.t)
+			{
+				h = hit;
+			}
+		}
+		for (int i{}; i < tri_p1.size(); i++)
+		{
+			if (!visible[tri_object[i]])
+			{
+				continue;
+			}
+			hit_information hit{intersect_triangle(i, r)};
+			if (hit.hits != 0 && hit.t < h.t)
+			{
+				h = hit;
+			}
+		}
+		for (int i{}; i < inst_mesh.size(); i++)
+		{
+			if (!visible[inst_object[i]])
+			{
+				continue;
+			}
+			hit_information hit{intersect_instance(i, r)};
+			if (hit.hits != 0 && hit.t < h.t)
+			{
+				h = hit;
+			}
+		}
+	}
+
+	bool any(ray& r, float tmax, const hit_information& from) const
+	{
+		for (int i{}; i < sphere_center.size(); i++)
+		{
+			if (sphere_object[i] != from.obj && visible[sphere_object[i]] && occludes_sphere(i, r, tmax))
+			{
+				return true;
+			}
+		}
+		for (int i{}; i < tri_p1.size(); i++)
+		{
+			if (tri_object[i] != from.obj && visible[tri_object[i]] && occludes_triangle(i, r, tmax))
+			{
+				return true;
+			}
+		}
+		for (int i{}; i < inst_mesh.size(); i++)
+		{
+			int obj{inst_object[i]};
+			if (visible[obj] && occludes_instance(i, r, tmax, obj == from.obj ? from.prim : -1))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	hit_information intersect_sphere(int s, ray& view_ray) const
+	{
+		glm::vec3 center{sphere_center[s]};
+		float r{sphere_radius[s]};
+
+		hit_information i{};
+		i.obj = sphere_object[s];
+		glm::vec3 ec{view_ray.p-center};
+		float dd{glm::dot(view_ray.d, view_ray.d)};
+		float discriminant = glm::pow(glm::dot(view_ray.d, ec), 2) - dd * (glm::dot(ec, ec) - glm::pow(r, 2));
+		if (discriminant >= 0) // at least one solutions
+		{
+			// ray goes through object
+			i.t = glm::min((glm::dot(-view_ray.d, ec) - glm::sqrt(discriminant)) / dd, (glm::dot(-view_ray.d, ec) + glm::sqrt(discriminant)) / dd);
+			if (i.t < 0)
+			{
+				return i;
+			}
+			i.normal = (view_ray.evaluate(i.t)-center)/r;
+			i.hits = 2;
+
+			if (discriminant == 0) // one solution
+			{
+				// ray is tangent to object
+				i.hits = 1;
+			}
+		}
+
+		// if ray misses object, do nothing
+
+		return i;
+	}
+
+	bool occludes_sphere(int s, ray& view_ray, float tmax) const
+	{
+		glm::vec3 ec{view_ray.p-sphere_center[s]};
+		float r{sphere_radius[s]};
+		float dd{glm::dot(view_ray.d, view_ray.d)};
+		float b{glm::dot(view_ray.d, ec)};
+		float discriminant{b*b - dd * (glm::dot(ec, ec) - r*r)};
+		if (discriminant < 0)
+		{
+			return false;
+		}
+		float t{(-b - glm::sqrt(discriminant)) / dd};
+		return t >= 0 && t < tmax;
+	}
+
+	// moller-trumbore on the prepared edges, plane triangles only need the plane distance
+	hit_information intersect_triangle(int tri, ray& view_ray) const
+	{
+		hit_information h{};
+		h.obj=tri_object[tri];
+		float t{};
+		if (triangle_distance(tri, view_ray, t))
+		{
+			h.t=t;
+			h.normal=tri_normal[tri];
+			h.hits=1;
+		}
+		return h;
+	}
+
+	bool occludes_triangle(int tri, ray& view_ray, float tmax) const
+	{
+		float t{};
+		return triangle_distance(tri, view_ray, t) && t < tmax;
+	}
+
+	bool triangle_distance(int tri, ray& view_ray, float& t) const
+	{
+		if (tri_plane[tri])
+		{
+			glm::vec3 tvec{view_ray.p-tri_p1[tri]};
+			glm::vec3 normal{tri_normal[tri]};
+			t=glm::dot(-tvec, normal)/glm::dot(normal, view_ray.d);
+			return t >= 0;
+		}
+		return moller_trumbore(tri_p1[tri], tri_e1[tri], tri_e2[tri], view_ray, t);
+	}
+
+	// the ray is moved into mesh space without normalizing the direction, so distances stay world distances
+	ray to_instance(int inst, const ray& view_ray) const
+	{
+		const glm::mat4& inv{inst_inverse[inst]};
+		return ray{glm::vec3{inv * glm::vec4{view_ray.p, 1.0f}}, glm::vec3{inv * glm::vec4{view_ray.d, 0.0f}}};
+	}
+
+	hit_information intersect_instance(int inst, ray& view_ray) const
+	{
+		hit_information h{};
+		int m{inst_mesh[inst]};
+		int first{mesh_first[m]};
+		ray local{to_instance(inst, view_ray)};
+		mesh_bvh[m].closest(local, h, [&](int t)
+		{
+			hit_information hit{};
+			float dist{};
+			if (moller_trumbore(mesh_p1[first + t], mesh_e1[first + t], mesh_e2[first + t], local, dist))
+			{
+				hit.t = dist;
+				hit.prim = t;
+				hit.hits = 1;
+			}
+			return hit;
+		});
+		if (h.hits != 0)
+		{
+			// normals go back to world space with the inverse transpose
+			h.obj = inst_object[inst];
+			h.normal = glm::normalize(glm::transpose(glm::mat3{inst_inverse[inst]}) * mesh_normal[first + h.prim]);
+		}
+		return h;
+	}
+
+	bool occludes_instance(int inst, ray& view_ray, float tmax, int skip) const
+	{
+		int m{inst_mesh[inst]};
+		int first{mesh_first[m]};
+		ray local{to_instance(inst, view_ray)};
+		return mesh_bvh[m].any(local, tmax, [&](int t)
+		{
+			float dist{};
+			return t != skip && moller_trumbore(mesh_p1[first + t], mesh_e1[first + t], mesh_e2[first + t], local, dist) && dist < tmax;
+		});
+	}
+
+private:
+	int add_object(shape k, int i, int m, glm::vec3 c)
+	{
+		dirty = true;
+		kind.push_back(k);
+		index.push_back(i);
+		mat.push_back(m);
+		color.push_back(c);
+		visible.push_back(true);
+		return kind.size() - 1;
+	}
+};
+
+#endif
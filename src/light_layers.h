@@ -0,0 +1,98 @@
+#ifndef LIGHT_LAYERS_H
+#define LIGHT_LAYERS_H
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#include "engine.h"
+#include "gbuffer.h"
+#include "bvh.h" // RT_SSE
+
+// contribution of every point light to every cached pixel with the color of the light factored out,
+// so recoloring a light only sums the layers again and moving one recomputes its own layer.
+// every layer is stored as one plane per channel, the ambient light of the path goes to base
+struct light_layers
+{
+	shading_key key{};
+	std::vector<point_light> lights{}; // positions and visibility the layers were computed for
+	bool valid{false};
+
+	std::vector<float> base{};
+	std::vector<float> linear{};
+	std::vector<float> quadratic{}; // blinn phong only
+	std::vector<float> sum{};
+
+	static constexpr size_t chunk{1024};
+
+	void resize(const shading_key& k)
+	{
+		key = k;
+		base.assign(k.pixels * 3, 0.0f);
+		linear.assign(k.pixels * 3 * k.lights, 0.0f);
+		quadratic.assign(k.blinn_phong ? k.pixels * 3 * k.lights : 0, 0.0f);
+		sum.resize(k.pixels * 3);
+	}
+
+	float* plane(std::vector<float>& layer, size_t light, int channel)
+	{
+		return layer.data() + (light * 3 + channel) * key.pixels;
+	}
+
+	bool stale(size_t l, const point_light& light) const
+	{
+		return !valid || lights[l].p != light.p || lights[l].visible != light.visible;
+	}
+
+	// sums the layers of the pixels in [first, last) for the current light colors, chunks keep the sum in cache
+	void combine(const std::vector<point_light>& point_lights, size_t first, size_t last, unsigned char* image)
+	{
+		for (size_t c0{first}; c0 < last; c0 += chunk)
+		{
+			size_t n{std::min(chunk, last - c0)};
+			for (int c{}; c < 3; c++)
+			{
+				float* out{sum.data() + c * key.pixels + c0};
+				std::memcpy(out, base.data() + c * key.pixels + c0, n * sizeof(float));
+				for (size_t l{}; l < point_lights.size(); l++)
+				{
+					if (!point_lights[l].visible)
+					{
+						continue;
+					}
+					float s{point_lights[l].color[c]};
+					add_scaled(out, plane(linear, l, c) + c0, s, n);
+					if (key.blinn_phong)
+					{
+						add_scaled(out, plane(quadratic, l, c) + c0, s * s, n);
+					}
+				}
+			}
+			for (size_t i{c0}; i < c0 + n; i++)
+			{
+				for (int c{}; c < 3; c++)
+				{
+					image[i * 3 + c] = glm::clamp(sum[c * key.pixels + i], 0.0f, 1.0f) * 255;
+				}
+			}
+		}
+	}
+
+	static void add_scaled(float* out, const float* in, float s, size_t n)
+	{
+		size_t i{};
+#ifdef RT_SSE
+		__m128 vs{_mm_set1_ps(s)};
+		for (; i + 4 <= n; i += 4)
+		{
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), vs)));
+		}
+#endif
+		for (; i < n; i++)
+		{
+			out[i] += in[i] * s;
+		}
+	}
+};
+
+#endif
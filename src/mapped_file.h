@@ -0,0 +1,104 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// private copy-on-write mapping of a whole file, writes through data() never reach the file
+struct mapped_file
+{
+	char* data{nullptr};
+	size_t size{};
+
+	mapped_file()
+	{
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		HANDLE file{CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)};
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER file_size{};
+		GetFileSizeEx(file, &file_size);
+		HANDLE mapping{CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL)};
+		CloseHandle(file);
+		if (mapping == NULL)
+		{
+			return false;
+		}
+		data = (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		CloseHandle(mapping);
+		if (data == NULL)
+		{
+			return false;
+		}
+		size = file_size.QuadPart;
+#else
+		int fd{::open(path.c_str(), O_RDONLY)};
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat st{};
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void* p{mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)};
+		::close(fd);
+		if (p == MAP_FAILED)
+		{
+			return false;
+		}
+		data = (char*)p;
+		size = st.st_size;
+#endif
+		return true;
+	}
+
+	void close()
+	{
+		if (!data)
+		{
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(data, size);
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	~mapped_file()
+	{
+		close();
+	}
+};
+
+#endif
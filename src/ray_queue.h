@@ -0,0 +1,55 @@
+#ifndef RAY_QUEUE_H
+#define RAY_QUEUE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+
+#include "engine.h"
+
+// binning of queued rays for the wavefront renderer, rays with equal keys share the direction octant,
+// have similar directions within it and start in the same cell of the scene bounds
+constexpr int ray_key_bits{16};
+
+inline unsigned ray_key(const ray& r, const aabb& bounds)
+{
+	glm::vec3 d{glm::abs(r.d) / glm::max(glm::max(glm::abs(r.d.x), glm::abs(r.d.y)), glm::abs(r.d.z))};
+	unsigned octant{(r.d.x < 0 ? 1u : 0u) | (r.d.y < 0 ? 2u : 0u) | (r.d.z < 0 ? 4u : 0u)};
+	unsigned direction{};
+	for (int a{}; a < 3; a++)
+	{
+		direction = direction << 2 | (unsigned)glm::clamp(d[a] * 4.0f, 0.0f, 3.0f);
+	}
+
+	// 7 bits of origin cell, interleaved so neighbouring cells get neighbouring keys
+	glm::vec3 extent{glm::max(bounds.max - bounds.min, glm::vec3{1e-6f})};
+	glm::vec3 cell{glm::clamp((r.p - bounds.min) / extent, 0.0f, 1.0f) * 3.999f};
+	unsigned x{(unsigned)cell.x};
+	unsigned y{(unsigned)cell.y};
+	unsigned z{(unsigned)(cell.z * 2.0f)};
+	unsigned origin{(z & 4) << 4 | (z & 2) << 4 | (y & 2) << 3 | (x & 2) << 2 | (z & 1) << 2 | (y & 1) << 1 | (x & 1)};
+
+	return octant << 13 | direction << 7 | origin;
+}
+
+// stable counting sort, returns the positions of keys in ascending key order
+inline std::vector<int> binned_order(const std::vector<unsigned>& keys)
+{
+	std::vector<int> start((1 << ray_key_bits) + 1);
+	for (unsigned k : keys)
+	{
+		start[k + 1]++;
+	}
+	for (size_t b{1}; b < start.size(); b++)
+	{
+		start[b] += start[b - 1];
+	}
+	std::vector<int> order(keys.size());
+	for (size_t i{}; i < keys.size(); i++)
+	{
+		order[start[keys[i]]++] = i;
+	}
+	return order;
+}
+
+#endif
@@ -1,14 +1,31 @@
 #ifndef RAYTRACER_H
 #define RAYTRACER_H
 
+#ifndef RT_HEADLESS
 #include <GL/glew.h>
+#endif
 #include <vector>
 #include <list>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <bit>
 
 #include <stb_image_write.h>
 
 #include "engine.h"
+#include "geometry.h"
+#include "bvh.h"
 #include "animation.h"
+#include "thread_pool.h"
+#include "column.h"
+#include "mapped_file.h"
+#include "ray_queue.h"
+#include "gbuffer.h"
+#include "light_layers.h"
+#include "render_stats.h"
+#include "trace.h"
 
 struct ray_tracer
 {
@@ -21,102 +38,331 @@ struct ray_tracer
 	int width  = glm::pow(2, res_pow); // keep it in powers of 2!
 	int height = width; // keep it in powers of 2!
 	unsigned char* image{new unsigned char[width*height*3]};
-	std::vector<surface*> scene{};
+	geometry_store geo{};
 	std::vector<ambient_light> ambient_lights{};
 	std::vector<point_light> point_lights{};
-	std::vector<material*> materials{};
+	column<material> materials{};
+
+	// keeps a mapped snapshot alive while the columns above view it
+	std::shared_ptr<mapped_file> snapshot{};
 
 	bool blinn_phong{false};
 	int bounce_count{1};
+	// a path stops reflecting once the product of the k_s along it drops below this,
+	// the default is below what an 8 bit channel can show
+	float min_throughput{1.0f / 256};
 
-	ray_tracer()
-	{
-		cam.nx=width;
-		cam.ny=height;
+	// acceleration structure over the bounded objects of the scene
+	bvh accel{};
+	column<int> unbounded{};
+	bool accel_valid{false};
+	bool use_bvh{true};
+	bool wide_bvh{true}; // traverse the 4-wide nodes of every bvh, false walks the binary nodes
 
-		materials.push_back(new material{0.5, 0.4, 0.8, 32, true});
-		materials.push_back(new material{0.25, 0.4, 0.6, 100, true});
-		materials.push_back(new material{0.4, 0.4, 0.25, 16});
-		materials.push_back(new material{0.5, 0.2, 0.2, 8});
+	// tiles of the framebuffer are rendered by a persistent pool, 0 threads uses every core
+	thread_pool pool{};
+	int thread_count{0};
+	int tile_size{16};
 
-		glm::vec3 points[4]=
-		{
-			glm::vec3(0, 3, 0),
-			glm::vec3(1, 1, -1),
-			glm::vec3(-1, 1, -1),
-			glm::vec3(0, 1, 1)
-		};
-		scene.push_back(new triangle{points[1], points[2], points[3]});
-		scene.back()->m=materials[0];
-		scene.push_back(new triangle{points[0], points[1], points[2]});
-		scene.back()->m=materials[0];
-		scene.push_back(new triangle{points[0], points[2], points[3]});
-		scene.back()->m=materials[0];
-		scene.push_back(new triangle{points[0], points[3], points[1]});
-		scene.back()->m=materials[0];
+	// the interactive preview traces one ray per 8x8 block first and refines while nothing changes
+	bool progressive{true};
+
+	// primary rays of 4x4 neighbouring blocks and their shadow rays are traced as packets through the bvh
+	bool packets{true};
+	static constexpr int packet_width{4};
 
-		scene.push_back(new sphere{});
-		scene.back()->m=materials[1];
-		scene.back()->color=glm::vec3{75.0f/255, 255.0f/255, 0.0f/255};
-		scene.back()->r=1.5f;
-		scene.back()->center=glm::vec3{-3.0, 2.0, 0};
+	// renders waves of paths stage by stage instead of tile by tile, the shadow and reflection rays of the
+	// bounces are binned by direction and origin so their packets stay coherent
+	bool wavefront{false};
+	static constexpr int wave_size{1 << 16};
+	static constexpr int packets_per_task{16};
 
-		scene.push_back(new sphere{});
-		scene.back()->m=materials[2];
-		scene.back()->color=glm::vec3{0.0f/255, 210.0f/255, 255.0f/255};
-		scene.back()->r=0.5f;
-		scene.back()->center=glm::vec3{-5, 2.5, 2.0};
-		// scene.back()->center=glm::vec3{0, 2.0, -2.0};
+	// keeps the primary hits of the last image so a full resolution render after an edit of only
+	// materials or lights shades them again without tracing primary rays
+	bool shading_cache{true};
+	gbuffer cache{};
 
-		scene.push_back(new triangle{});
-		scene.back()->m=materials[3];
-		scene.back()->color=glm::vec3{200.0f/255, 200.0f/255, 200.0f/255};
-		dynamic_cast<triangle*>(scene.back())->plane=true;
+	// bumped by every edit of materials, object colors or ambient lights, so the shading cache compares a counter
+	// instead of the arrays. copy_scene bumps it for the edits the ui marks as scene_objects
+	unsigned shading_version{};
 
+	// with the shading cache, keeps the contribution of every point light in its own layer so recoloring
+	// a light only sums the layers and moving one only recomputes its layer
+	bool relight_layers{false};
+	light_layers layers{};
 
-		ambient_lights.push_back(ambient_light{});
+	// bounds the objects in geo.moved had in the last image, filled by copy_scene. with them a full resolution
+	// render after a move only traces the pixels the moved objects can change
+	std::vector<aabb> moved_from{};
+	// a region covering more of the image than this is rendered in full
+	static constexpr float max_region{0.5f};
 
-		point_lights.push_back(point_light{glm::vec3{-2.0, 4.0, -3.0}, glm::vec3{0, 1, 1}, glm::vec3{1, 0, 1}, 1.0f});
-		point_lights.push_back(point_light{glm::vec3{-0.5, 3.5, 0.5}, glm::vec3{1, 1, 0}, glm::vec3{1, 0, 0.5}, 1.5f});
+	// rays, intersection tests and, with timers, the time in the hot functions of the last render
+	render_counters counters{};
+	bool timers{false};
 
-		cam.e=glm::vec3{1.5f, 4.0f, -2.0f};
+	// shows the cost of every pixel in false color instead of the shaded image, red is heatmap_max
+	heatmap_view heatmap{heatmap_view::off};
+	std::vector<unsigned> pixel_cost{};
+	unsigned heatmap_max{};
 
-		lookat(glm::vec3{-0.5, 1.5, 0.0});
+	// when the first tile of the last render finished
+	std::chrono::steady_clock::time_point first_tile{};
+
+	// starts empty, scenes are filled in by load_scene or load_scene_text from scene_io.h
+	ray_tracer()
+	{
+		cam.nx=width;
+		cam.ny=height;
 	}
 
 	void addSphere()
 	{
-		scene.push_back(new sphere{});
-		scene.back()->m=materials[0];
+		geo.add_sphere(glm::vec3{0, 0, 0}, 1.0f, 0);
 	}
 
 	void addTriangle()
 	{
-		scene.push_back(new triangle{});
-		scene.back()->m=materials[0];
+		geo.add_triangle(glm::vec3{-1, 0, -1}, glm::vec3{-1, 0, 1}, glm::vec3{1, 0, 1}, 0);
+	}
+
+	void addInstance()
+	{
+		if (geo.meshes() > 0)
+		{
+			geo.add_instance(0, glm::mat4{1.0f});
+		}
+	}
+
+	// prepare the geometry and rebuild the acceleration structure after objects were added or removed,
+	// moved objects are only prepared and refitted until the refitted tree has degraded too far.
+	// keep_hits leaves the cached hits for render_region to update after a move
+	void commit(bool keep_hits=false)
+	{
+		trace_scope scope{"commit"};
+		accel.wide_traversal = wide_bvh;
+		for (bvh& b : geo.mesh_bvh)
+		{
+			b.wide_traversal = wide_bvh;
+		}
+		if (geo.dirty)
+		{
+			geo.prepare();
+			geo.dirty = false;
+			geo.moved.clear();
+			accel_valid = false;
+			cache.invalidate();
+		}
+		else if (!geo.moved.empty())
+		{
+			for (int obj : geo.moved)
+			{
+				geo.prepare_object(obj);
+			}
+			if (!keep_hits)
+			{
+				cache.invalidate();
+			}
+			if (accel_valid)
+			{
+				accel.refit(geo.moved, [this](int i) { return geo.bounds(i); });
+				accel_valid = !accel.degraded();
+			}
+			geo.moved.clear();
+		}
+		if (!use_bvh || accel_valid)
+		{
+			return;
+		}
+
+		std::vector<aabb> boxes(geo.size());
+		int chunks{std::min(geo.size(), std::max(1, pool.size()) * 4)};
+		pool.run(chunks, [&](int c, int)
+		{
+			for (int i{geo.size() * c / chunks}; i < geo.size() * (c + 1) / chunks; i++)
+			{
+				if (geo.bounded(i))
+				{
+					boxes[i] = geo.bounds(i);
+				}
+			}
+		});
+		std::vector<int> prims{};
+		unbounded.clear();
+		for (int i{}; i < geo.size(); i++)
+		{
+			if (geo.bounded(i))
+			{
+				prims.push_back(i);
+			}
+			else
+			{
+				unbounded.push_back(i);
+			}
+		}
+		accel.build(boxes, prims, &pool);
+		accel_valid = true;
 	}
 
 	hit_information calculate_hit(ray& r)
 	{
+		render_counts& c{counters.local()};
+		scoped_timer timer{timers ? &c.hit_ns : nullptr};
+		if (!use_bvh)
+		{
+			return calculate_hit_linear(r);
+		}
+
 		hit_information h{};
-		for (auto& obj : scene)
+		auto intersect{[&](int i)
 		{
-			if (obj->visible == false)
+			if (!geo.visible[i])
 			{
-				continue;
+				return hit_information{};
+			}
+			c.tested(geo.kind[i]);
+			return geo.intersect(i, r);
+		}};
+		for (int i : unbounded)
+		{
+			hit_information hit{intersect(i)};
+			if (hit.hits != 0 && hit.t < h.t)
+			{
+				h = hit;
+			}
+		}
+		accel.closest(r, h, intersect);
+		return h;
+	}
+
+	// closest hits of every ray in the packet, h has one entry per ray
+	void calculate_hits(ray_packet& pk, hit_information* h)
+	{
+		render_counts& c{counters.local()};
+		scoped_timer timer{timers ? &c.hit_ns : nullptr};
+		for (int k{}; k < pk.count; k++)
+		{
+			h[k] = use_bvh ? hit_information{} : calculate_hit_linear(pk.rays[k]);
+		}
+		if (!use_bvh)
+		{
+			return;
+		}
+
+		auto intersect{[&](int i, int k)
+		{
+			if (!geo.visible[i])
+			{
+				return hit_information{};
 			}
-			hit_information hit{obj->intersect(r)};
-			if (hit.hits != 0)
+			c.tested(geo.kind[i]);
+			return geo.intersect(i, pk.rays[k]);
+		}};
+		for (int i : unbounded)
+		{
+			for (int k{}; k < pk.count; k++)
 			{
-				if (hit.t < h.t)
+				hit_information hit{intersect(i, k)};
+				if (hit.hits != 0 && hit.t < h[k].t)
 				{
-					h = hit;
+					h[k] = hit;
 				}
 			}
 		}
+		accel.closest(pk, pk.all(), h, intersect);
+	}
+
+	hit_information calculate_hit_linear(ray& r)
+	{
+		count_linear(counters.local());
+		hit_information h{};
+		geo.closest(r, h);
 		return h;
 	}
 
+	// the linear scan counts every primitive it may test
+	void count_linear(render_counts& c) const
+	{
+		c.sphere_tests += geo.sphere_center.size();
+		c.triangle_tests += geo.tri_p1.size();
+		c.instance_tests += geo.inst_mesh.size();
+	}
+
+	// from is the hit the shadow ray starts at
+	bool occluded(ray& r, float tmax, const hit_information& from)
+	{
+		render_counts& c{counters.local()};
+		scoped_timer timer{timers ? &c.shadow_ns : nullptr};
+		c.shadow++;
+		if (!use_bvh)
+		{
+			count_linear(c);
+			return geo.any(r, tmax, from);
+		}
+
+		auto occludes{[&](int i)
+		{
+			if (!geo.visible[i])
+			{
+				return false;
+			}
+			c.tested(geo.kind[i]);
+			return geo.occludes(i, r, tmax, from);
+		}};
+		for (int i : unbounded)
+		{
+			if (occludes(i))
+			{
+				return true;
+			}
+		}
+		return accel.any(r, tmax, occludes);
+	}
+
+	// the active rays of the packet that are occluded before tmax[k], from[k] is the hit ray k starts at
+	unsigned occluded(ray_packet& pk, unsigned active, const float* tmax, const hit_information* from)
+	{
+		render_counts& c{counters.local()};
+		scoped_timer timer{timers ? &c.shadow_ns : nullptr};
+		c.shadow += std::popcount(active);
+		unsigned hit{};
+		auto occludes{[&](int i, int k)
+		{
+			if (!geo.visible[i])
+			{
+				return false;
+			}
+			c.tested(geo.kind[i]);
+			return geo.occludes(i, pk.rays[k], tmax[k], from[k]);
+		}};
+		for (int k{}; k < pk.count; k++)
+		{
+			if (!(active >> k & 1))
+			{
+				continue;
+			}
+			if (!use_bvh)
+			{
+				count_linear(c);
+				hit |= geo.any(pk.rays[k], tmax[k], from[k]) ? 1u << k : 0u;
+				continue;
+			}
+			for (int i : unbounded)
+			{
+				if (occludes(i, k))
+				{
+					hit |= 1u << k;
+					break;
+				}
+			}
+		}
+		if (!use_bvh || hit == active)
+		{
+			return hit;
+		}
+		return hit | accel.any(pk, active & ~hit, tmax, occludes);
+	}
+
 	void lookat(glm::vec3 point)
 	{
 		glm::vec3 d{glm::normalize(cam.e-point)};
@@ -125,44 +371,871 @@ struct ray_tracer
 		cam.v = glm::normalize(glm::cross(cam.u, cam.w));
 	}
 
+	// renders the current scene into image and uploads it to the bound texture
 	void update_image()
 	{
-		for(int i = 0; i < height; i++)
+		render();
+
+#ifndef RT_HEADLESS
+		if (image)
 		{
-			for (int j = 0; j < width; j++)
+			trace_scope scope{"upload"};
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		else
+		{
+			std::cout << "Failed to load texture" << std::endl;
+		}
+#endif
+	}
+
+	// renders into image on the pool without touching opengl, step > 1 traces one ray per step x step block
+	// and refine skips the rays the previous, twice as coarse pass already traced. every call is a frame of a trace capture
+	void render(int step=1, bool refine=false)
+	{
+		{
+			trace_scope scope{"render"};
+			scope.arg("step", step);
+			render_pass(step, refine);
+		}
+		tracer::get().frame_done();
+	}
+
+	void render_pass(int step, bool refine)
+	{
+		if (pool.requested != thread_count)
+		{
+			pool.start(thread_count);
+		}
+		counters.reset(pool.size());
+		if (heatmap != heatmap_view::off)
+		{
+			moved_from.clear();
+			commit();
+			cache.invalidate();
+			render_heatmap(step, refine);
+			return;
+		}
+		std::vector<aabb> changed{};
+		std::vector<int> moved{};
+		bool patch{step == 1 && !refine && patchable()};
+		if (patch)
+		{
+			changed = moved_from;
+			moved = geo.moved;
+			for (int obj : geo.moved)
 			{
-				int idx = (i * width + j) * 3;
+				changed.push_back(geo.bounds(obj));
+			}
+		}
+		moved_from.clear();
+		commit(patch);
+		if (patch)
+		{
+			if (render_region(changed, moved))
+			{
+				return;
+			}
+			cache.invalidate();
+		}
+
+		if (step == 1 && !refine && cached())
+		{
+			reshade();
+			return;
+		}
+		if (shading_cache)
+		{
+			cache.begin(width, height, cam, geo.visible);
+		}
+		if (wavefront)
+		{
+			render_wavefront(step, refine);
+		}
+		else
+		{
+			render_tiles(step, refine);
+		}
+		if (shading_cache)
+		{
+			cache.rendered(step, refine);
+			if (cache.coverage == 1)
+			{
+				cache.shade(shading(), point_lights);
+			}
+		}
+	}
+
+	// whether the next full resolution render can reshade the cached hits, moved objects are committed first
+	bool cached() const
+	{
+		return shading_cache && !geo.dirty && geo.moved.empty() && cache.complete(width, height, cam, geo.visible);
+	}
+
+	// whether the next full resolution render only has to update the region of the moved objects
+	bool patchable() const
+	{
+		if (!shading_cache || geo.dirty || geo.moved.empty() || moved_from.size() != geo.moved.size()
+			|| !cache.complete(width, height, cam, geo.visible) || !cache.image_shaded)
+		{
+			return false;
+		}
+		for (int obj : geo.moved)
+		{
+			if (!geo.bounded(obj))
+			{
+				return false;
+			}
+		}
+		return cache.shaded_lights == point_lights && cache.shaded == shading();
+	}
+
+	shading_key shading() const
+	{
+		return shading_key{cache.version, shading_version, (size_t)width * height, point_lights.size(), blinn_phong, bounce_count, min_throughput};
+	}
+
+	void render_tiles(int step, bool refine)
+	{
+		int tile{glm::max(1, tile_size)};
+		int tiles_x{(width + tile - 1) / tile};
+		int tiles_y{(height + tile - 1) / tile};
+		std::atomic<bool> first{true};
+		pool.run(tiles_x * tiles_y, [&](int task, int)
+		{
+			trace_scope scope{"tile", task};
+			int x0{(task % tiles_x) * tile};
+			int y0{(task / tiles_x) * tile};
+			render_tile(x0, y0, glm::min(x0 + tile, width), glm::min(y0 + tile, height), step, refine, &scope);
+			if (first.exchange(false))
+			{
+				first_tile = std::chrono::steady_clock::now();
+			}
+		});
+	}
+
+	// blocks start on multiples of step and belong to the tile holding their first pixel.
+	// while a trace capture runs the time of the phases is added up over the pixels and kept with the tile,
+	// the shader traces the shadow rays of a single ray so they count as shading here
+	void render_tile(int x0, int y0, int x1, int y1, int step=1, bool refine=false, trace_scope* scope=nullptr)
+	{
+		if (packets)
+		{
+			render_packets(x0, y0, x1, y1, step, refine, scope);
+			return;
+		}
+		trace_phases phases{scope, "generate_us", "traverse_us", "shade_us"};
+		for (int i{(y0 + step - 1) / step * step}; i < y1; i += step)
+		{
+			for (int j{(x0 + step - 1) / step * step}; j < x1; j += step)
+			{
+				if (refine && i % (2 * step) == 0 && j % (2 * step) == 0)
+				{
+					continue;
+				}
 
 				ray r{cam.generate_ray(j, i)};
+				counters.local().primary++;
+				phases.mark(0);
 
 				hit_information closest_hit{calculate_hit(r)};
-				
+				if (shading_cache)
+				{
+					cache.store(j, i, r, closest_hit);
+				}
+				phases.mark(1);
+
 				glm::vec3 color{};
-				int depth{};
 				if (closest_hit.hits != 0)
 				{
-					color=shader(r, closest_hit, depth);
+					color=shader(r, closest_hit);
 				}
 				else
 				{
 					color=glm::vec3{0, 0, 0}; // background color
 				}
-				color = glm::clamp(color, 0.0f, 1.0f);
-				
-				image[idx+0] = color.r * 255;
-				image[idx+1] = color.g * 255;
-				image[idx+2] = color.b * 255;
+				fill(j, i, step, color);
+				phases.mark(2);
 			}
 		}
+	}
 
-		if (image)
+	// the blocks of render_tile traced ray by ray, so the cost of a block is the difference of the counters of its thread,
+	// then every pixel is colored by its cost relative to the most expensive one
+	void render_heatmap(int step, bool refine)
+	{
+		pixel_cost.resize((size_t)width * height);
+		int tile{glm::max(1, tile_size)};
+		int tiles_x{(width + tile - 1) / tile};
+		int tiles_y{(height + tile - 1) / tile};
+		pool.run(tiles_x * tiles_y, [&](int task, int)
 		{
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-			glGenerateMipmap(GL_TEXTURE_2D);
+			trace_scope scope{"heatmap tile", task};
+			int x0{(task % tiles_x) * tile};
+			int y0{(task / tiles_x) * tile};
+			for (int i{(y0 + step - 1) / step * step}; i < glm::min(y0 + tile, height); i += step)
+			{
+				for (int j{(x0 + step - 1) / step * step}; j < glm::min(x0 + tile, width); j += step)
+				{
+					if (refine && i % (2 * step) == 0 && j % (2 * step) == 0)
+					{
+						continue;
+					}
+					render_counts& c{counters.local()};
+					render_counts before{c};
+					unsigned long long visited{bvh::visited};
+
+					ray r{cam.generate_ray(j, i)};
+					c.primary++;
+					hit_information hit{calculate_hit(r)};
+					if (hit.hits != 0)
+					{
+						shader(r, hit);
+					}
+
+					unsigned long long cost{heatmap == heatmap_view::tests ? c.tests() - before.tests()
+						: heatmap == heatmap_view::steps ? bvh::visited - visited : c.rays() - before.rays()};
+					for (int y{i}; y < glm::min(i + step, height); y++)
+					{
+						for (int x{j}; x < glm::min(j + step, width); x++)
+						{
+							pixel_cost[(size_t)y * width + x] = cost;
+						}
+					}
+				}
+			}
+		});
+		first_tile = std::chrono::steady_clock::now();
+
+		heatmap_max = std::max(1u, *std::max_element(pixel_cost.begin(), pixel_cost.end()));
+		pool.run(height, [&](int i, int)
+		{
+			for (int j{}; j < width; j++)
+			{
+				fill(j, i, 1, heat(pixel_cost[(size_t)i * width + j] / (float)heatmap_max));
+			}
+		});
+	}
+
+	// dark blue for cheap pixels over cyan, green and yellow to red for the most expensive ones
+	static glm::vec3 heat(float t)
+	{
+		static const glm::vec3 stops[]{{0.0f, 0.0f, 0.5f}, {0.0f, 0.5f, 1.0f}, {0.0f, 0.8f, 0.3f}, {1.0f, 0.9f, 0.0f}, {1.0f, 0.0f, 0.0f}};
+		t = glm::clamp(t, 0.0f, 1.0f) * 4.0f;
+		int k{glm::min(static_cast<int>(t), 3)};
+		return glm::mix(stops[k], stops[k + 1], t - k);
+	}
+
+	// same blocks as render_tile, grouped into packets of packet_width x packet_width blocks. the shadow rays
+	// of a packet towards each point light are traced as one packet as well before its hits are shaded.
+	// while a trace capture runs the time of the phases is added up over the packets and kept with the tile
+	void render_packets(int x0, int y0, int x1, int y1, int step, bool refine, trace_scope* scope=nullptr)
+	{
+		// ray generation, traversal of the primary and shadow rays, shading
+		trace_phases phases{scope, "generate_us", "traverse_us", "shade_us"};
+		std::vector<unsigned> shadowed(point_lights.size());
+		int span{packet_width * step};
+		for (int pi{(y0 + step - 1) / step * step}; pi < y1; pi += span)
+		{
+			for (int pj{(x0 + step - 1) / step * step}; pj < x1; pj += span)
+			{
+				ray_packet pk{};
+				int px[ray_packet::capacity];
+				int py[ray_packet::capacity];
+				for (int i{pi}; i < glm::min(pi + span, y1); i += step)
+				{
+					for (int j{pj}; j < glm::min(pj + span, x1); j += step)
+					{
+						if (refine && i % (2 * step) == 0 && j % (2 * step) == 0)
+						{
+							continue;
+						}
+						px[pk.count] = j;
+						py[pk.count] = i;
+						pk.add(cam.generate_ray(j, i));
+					}
+				}
+				phases.mark(0);
+				if (pk.count == 0)
+				{
+					continue;
+				}
+
+				hit_information hits[ray_packet::capacity];
+				calculate_hits(pk, hits);
+				counters.local().primary += pk.count;
+				unsigned hit_mask{};
+				for (int k{}; k < pk.count; k++)
+				{
+					hit_mask |= hits[k].hits != 0 ? 1u << k : 0u;
+					if (shading_cache)
+					{
+						cache.store(px[k], py[k], pk.rays[k], hits[k]);
+					}
+				}
+				for (size_t l{}; l < point_lights.size(); l++)
+				{
+					shadowed[l] = 0;
+					if (!point_lights[l].visible || hit_mask == 0)
+					{
+						continue;
+					}
+					ray_packet shadow{};
+					float tmax[ray_packet::capacity]{};
+					for (int k{}; k < pk.count; k++)
+					{
+						shadow.add(point_lights[l].shadow_ray(pk.rays[k], hits[k], tmax[k]));
+					}
+					shadowed[l] = occluded(shadow, hit_mask, tmax, hits);
+				}
+				phases.mark(1);
+
+				for (int k{}; k < pk.count; k++)
+				{
+					glm::vec3 color{};
+					if (hits[k].hits != 0)
+					{
+						color = shader(pk.rays[k], hits[k], shadowed.data(), k);
+					}
+					fill(px[k], py[k], step, color);
+				}
+				phases.mark(2);
+			}
 		}
-		else
+	}
+
+	// the blocks of render_tile in waves of wave_size paths. a path follows one block through its reflections,
+	// each bounce is a stage that traces the rays of the live paths, then their shadow rays,
+	// then shades the hits and queues the reflection rays of glazed materials for the next stage.
+	// every path carries its color and throughput like the loop in shader, so both modes produce the same image
+	void render_wavefront(int step, bool refine)
+	{
+		std::vector<glm::ivec2> blocks{};
+		int span{packet_width * step};
+		for (int pi{}; pi < height; pi += span)
 		{
-			std::cout << "Failed to load texture" << std::endl;
+			for (int pj{}; pj < width; pj += span)
+			{
+				for (int i{pi}; i < glm::min(pi + span, height); i += step)
+				{
+					for (int j{pj}; j < glm::min(pj + span, width); j += step)
+					{
+						if (!(refine && i % (2 * step) == 0 && j % (2 * step) == 0))
+						{
+							blocks.push_back(glm::ivec2{j, i});
+						}
+					}
+				}
+			}
+		}
+
+		aabb bounds{accel.empty() ? aabb{cam.e - 1.0f, cam.e + 1.0f} : accel.nodes[0].box};
+		int lights{static_cast<int>(point_lights.size())};
+		size_t paths{glm::min(blocks.size(), (size_t)wave_size)};
+		std::vector<ray> rays(paths);
+		std::vector<hit_information> hits(paths);
+		std::vector<glm::vec3> colors(paths);
+		std::vector<float> throughput(paths);
+		std::vector<unsigned> shadowed(paths * lights);
+		std::vector<int> live{};
+		for (size_t w{}; w < blocks.size(); w += wave_size)
+		{
+			int n{static_cast<int>(glm::min(blocks.size() - w, (size_t)wave_size))};
+			live.resize(n);
+			pool.run((n + 255) / 256, [&](int task, int)
+			{
+				trace_scope scope{"generate", task};
+				for (int p{task * 256}; p < glm::min(n, task * 256 + 256); p++)
+				{
+					rays[p] = cam.generate_ray(blocks[w + p].x, blocks[w + p].y);
+					colors[p] = glm::vec3{};
+					throughput[p] = 1.0f;
+					live[p] = p;
+				}
+			});
+
+			for (int depth{}; !live.empty(); depth++)
+			{
+				trace_stage(live, rays, hits, bounds, depth > 0);
+				(depth == 0 ? counters.local().primary : counters.local().reflection) += live.size();
+				if (depth == 0 && shading_cache)
+				{
+					for (int p : live)
+					{
+						cache.store(blocks[w + p].x, blocks[w + p].y, rays[p], hits[p]);
+					}
+				}
+
+				std::vector<int> lit{};
+				for (int p : live)
+				{
+					if (hits[p].hits != 0)
+					{
+						lit.push_back(p);
+					}
+				}
+				shadow_stage(lit, rays, hits, shadowed, bounds, depth > 0);
+
+				std::vector<int> next(lit.size(), -1);
+				int lit_count{static_cast<int>(lit.size())};
+				pool.run((lit_count + 255) / 256, [&](int task, int)
+				{
+					trace_scope scope{"shade", task};
+					for (int q{task * 256}; q < glm::min(lit_count, task * 256 + 256); q++)
+					{
+						int p{lit[q]};
+						render_counts& c{counters.local()};
+						scoped_timer timer{timers ? &c.shader_ns : nullptr};
+						const material& m{materials[geo.mat[hits[p].obj]]};
+						colors[p] += throughput[p] * direct(rays[p], hits[p], &shadowed[p * lights], 0);
+						throughput[p] *= m.k_s;
+						if (depth <= bounce_count && m.glazed && throughput[p] >= min_throughput)
+						{
+							rays[p] = reflection(rays[p], hits[p]);
+							next[q] = p;
+						}
+					}
+				});
+				live.clear();
+				for (int p : next)
+				{
+					if (p >= 0)
+					{
+						live.push_back(p);
+					}
+				}
+			}
+
+			pool.run((n + 255) / 256, [&](int task, int)
+			{
+				for (int p{task * 256}; p < glm::min(n, task * 256 + 256); p++)
+				{
+					fill(blocks[w + p].x, blocks[w + p].y, step, colors[p]);
+				}
+			});
+			if (w == 0)
+			{
+				first_tile = std::chrono::steady_clock::now();
+			}
+		}
+	}
+
+	// closest hits of the queued paths, traced as packets of neighbouring rays. primary rays are already
+	// coherent in block order, binning them would only scatter the blocks over the image
+	void trace_stage(const std::vector<int>& queue, std::vector<ray>& rays, std::vector<hit_information>& hits, const aabb& bounds, bool binned)
+	{
+		std::vector<unsigned> keys(queue.size());
+		for (size_t q{}; binned && q < queue.size(); q++)
+		{
+			keys[q] = ray_key(rays[queue[q]], bounds);
+		}
+		std::vector<int> order{binned_order(keys)};
+		int packet_count{static_cast<int>((queue.size() + ray_packet::capacity - 1) / ray_packet::capacity)};
+		pool.run((packet_count + packets_per_task - 1) / packets_per_task, [&](int task, int)
+		{
+			trace_scope scope{"traverse", task};
+			for (int b{task * packets_per_task}; b < glm::min(packet_count, (task + 1) * packets_per_task); b++)
+			{
+				ray_packet pk{};
+				int path[ray_packet::capacity];
+				for (size_t q{b * (size_t)ray_packet::capacity}; q < glm::min(queue.size(), (b + 1) * (size_t)ray_packet::capacity); q++)
+				{
+					path[pk.count] = queue[order[q]];
+					pk.add(rays[path[pk.count]]);
+				}
+				hit_information h[ray_packet::capacity];
+				calculate_hits(pk, h);
+				for (int k{}; k < pk.count; k++)
+				{
+					hits[path[k]] = h[k];
+				}
+			}
+		});
+	}
+
+	// one shadow ray per lit path and visible point light, traced as packets after binning them.
+	// the queue is laid out light by light, so rays leaving primary hits in block order are already grouped
+	// and are traced in place. sets shadowed[path * lights + light] to 1 when the light is occluded
+	void shadow_stage(const std::vector<int>& lit, std::vector<ray>& rays, const std::vector<hit_information>& hits, std::vector<unsigned>& shadowed, const aabb& bounds, bool binned)
+	{
+		int lights{static_cast<int>(point_lights.size())};
+		std::vector<int> visible{};
+		for (int l{}; l < lights; l++)
+		{
+			if (point_lights[l].visible)
+			{
+				visible.push_back(l);
+			}
+		}
+		int lit_count{static_cast<int>(lit.size())};
+		size_t count{lit.size() * visible.size()};
+		std::vector<ray> shadow_rays(count);
+		std::vector<float> tmax(count);
+		std::vector<unsigned> keys(binned ? count : 0);
+		pool.run((lit_count + 255) / 256, [&](int task, int)
+		{
+			for (int q{task * 256}; q < glm::min(lit_count, task * 256 + 256); q++)
+			{
+				int p{lit[q]};
+				for (int l{}; l < lights; l++)
+				{
+					shadowed[p * lights + l] = 0;
+				}
+				for (size_t v{}; v < visible.size(); v++)
+				{
+					size_t s{v * lit.size() + q};
+					shadow_rays[s] = point_lights[visible[v]].shadow_ray(rays[p], hits[p], tmax[s]);
+					if (binned)
+					{
+						keys[s] = ray_key(shadow_rays[s], bounds);
+					}
+				}
+			}
+		});
+
+		std::vector<int> order{binned ? binned_order(keys) : std::vector<int>{}};
+		int packet_count{static_cast<int>((count + ray_packet::capacity - 1) / ray_packet::capacity)};
+		pool.run((packet_count + packets_per_task - 1) / packets_per_task, [&](int task, int)
+		{
+			trace_scope scope{"shadow rays", task};
+			for (int b{task * packets_per_task}; b < glm::min(packet_count, (task + 1) * packets_per_task); b++)
+			{
+				ray_packet pk{};
+				float t[ray_packet::capacity];
+				hit_information from[ray_packet::capacity];
+				int slot[ray_packet::capacity];
+				for (size_t q{b * (size_t)ray_packet::capacity}; q < glm::min(count, (b + 1) * (size_t)ray_packet::capacity); q++)
+				{
+					int s{binned ? order[q] : static_cast<int>(q)};
+					int p{lit[s % lit_count]};
+					t[pk.count] = tmax[s];
+					from[pk.count] = hits[p];
+					slot[pk.count] = p * lights + visible[s / lit_count];
+					pk.add(shadow_rays[s]);
+				}
+				unsigned occluded_mask{occluded(pk, pk.all(), t, from)};
+				for (int k{}; k < pk.count; k++)
+				{
+					shadowed[slot[k]] = occluded_mask >> k & 1;
+				}
+			}
+		});
+	}
+
+	// shades every pixel from the cache, the shadow rays of a point light are only traced again when it moved
+	void reshade()
+	{
+		trace_scope scope{"reshade"};
+		if (relight_layers)
+		{
+			relight();
+			return;
+		}
+		std::vector<char> known{cached_shadows()};
+		std::atomic<bool> first{true};
+		pool.run(height, [&](int i, int)
+		{
+			for (int j{}; j < width; j++)
+			{
+				size_t idx{(size_t)i * width + j};
+				ray r{cache.rays[idx]};
+				hit_information hit{cache.hits[idx]};
+				glm::vec3 color{};
+				if (hit.hits != 0)
+				{
+					color = shader(r, hit, cached_shadows(idx, r, hit, known), 0);
+				}
+				fill(j, i, 1, color);
+			}
+			if (first.exchange(false))
+			{
+				first_tile = std::chrono::steady_clock::now();
+			}
+		});
+		cache.lights = point_lights;
+		cache.shadows_valid = true;
+		cache.shade(shading(), point_lights);
+	}
+
+	// which point lights still have their shadow bits in the cache, sizes the bits for the current lights
+	std::vector<char> cached_shadows()
+	{
+		std::vector<char> known(point_lights.size());
+		for (size_t l{}; l < point_lights.size(); l++)
+		{
+			known[l] = cache.shadow_valid(point_lights, l);
+		}
+		cache.shadowed.resize(cache.hits.size() * point_lights.size());
+		return known;
+	}
+
+	// shadow bits of the cached pixel idx, the ones of lights not known are traced and stored
+	unsigned* cached_shadows(size_t idx, ray& r, const hit_information& hit, const std::vector<char>& known)
+	{
+		unsigned* shadowed{&cache.shadowed[idx * point_lights.size()]};
+		for (size_t l{}; l < point_lights.size(); l++)
+		{
+			if (!known[l])
+			{
+				float tmax{};
+				ray sr{point_lights[l].shadow_ray(r, hit, tmax)};
+				shadowed[l] = point_lights[l].visible && occluded(sr, tmax, hit) ? 1 : 0;
+			}
+		}
+		return shadowed;
+	}
+
+	// reshade through the light layers, recomputes the layers of moved lights, or all of them when anything
+	// else they depend on changed, then sums the layers for the current light colors into the image
+	void relight()
+	{
+		trace_scope scope{"relight"};
+		size_t pixels{(size_t)width * height};
+		size_t lights{point_lights.size()};
+		shading_key key{shading()};
+		bool base{!layers.valid || !(layers.key == key)};
+		if (base)
+		{
+			layers.valid = false;
+			layers.resize(key);
+		}
+		std::vector<int> stale{};
+		for (size_t l{}; l < lights; l++)
+		{
+			if (layers.stale(l, point_lights[l]))
+			{
+				stale.push_back(l);
+			}
+		}
+
+		std::vector<char> known{cached_shadows()};
+		if (base || !stale.empty())
+		{
+			pool.run(height, [&](int i, int)
+			{
+				std::vector<glm::vec3> linear(stale.size());
+				std::vector<glm::vec3> quadratic(stale.size());
+				for (int j{}; j < width; j++)
+				{
+					size_t idx{(size_t)i * width + j};
+					ray r{cache.rays[idx]};
+					hit_information hit{cache.hits[idx]};
+					glm::vec3 ambient{};
+					std::fill(linear.begin(), linear.end(), glm::vec3{});
+					std::fill(quadratic.begin(), quadratic.end(), glm::vec3{});
+					if (hit.hits != 0)
+					{
+						unsigned* shadowed{cached_shadows(idx, r, hit, known)};
+						walk_path(r, hit, [&](ray& cr, hit_information& ch, int depth, float throughput)
+						{
+							const material& m{materials[geo.mat[ch.obj]]};
+							glm::vec3 albedo{geo.color[ch.obj]};
+							for (auto& l : ambient_lights)
+							{
+								if (l.visible)
+								{
+									ambient += throughput * l.illuminate(m, albedo);
+								}
+							}
+							for (size_t s{}; s < stale.size(); s++)
+							{
+								const point_light& l{point_lights[stale[s]]};
+								if (!l.visible)
+								{
+									continue;
+								}
+								float tmax{};
+								ray sr{l.shadow_ray(cr, ch, tmax)};
+								if (depth == 0 ? shadowed[stale[s]] != 0 : occluded(sr, tmax, ch))
+								{
+									continue;
+								}
+								glm::vec3 lin{};
+								glm::vec3 quad{};
+								l.response(cr, ch, sr.d, m, albedo, blinn_phong, lin, quad);
+								linear[s] += throughput * lin;
+								quadratic[s] += throughput * quad;
+							}
+						});
+					}
+					for (int c{}; c < 3; c++)
+					{
+						if (base)
+						{
+							layers.base[c * pixels + idx] = ambient[c];
+						}
+						for (size_t s{}; s < stale.size(); s++)
+						{
+							layers.plane(layers.linear, stale[s], c)[idx] = linear[s][c];
+							if (blinn_phong)
+							{
+								layers.plane(layers.quadratic, stale[s], c)[idx] = quadratic[s][c];
+							}
+						}
+					}
+				}
+			});
+			layers.lights = point_lights;
+			layers.valid = true;
+			cache.lights = point_lights;
+			cache.shadows_valid = true;
+		}
+
+		size_t chunks{(pixels + light_layers::chunk - 1) / light_layers::chunk};
+		pool.run(chunks, [&](int task, int)
+		{
+			size_t first{task * light_layers::chunk};
+			layers.combine(point_lights, first, glm::min(pixels, first + light_layers::chunk), image);
+		});
+		first_tile = std::chrono::steady_clock::now();
+		cache.shade(key, point_lights);
+	}
+
+	// traces the pixels the moved objects can change after a move and keeps the rest of the image. a pixel is
+	// dirty when it saw a moved object, lies in the projected old or new bounds of one, when a shadow ray of
+	// its hit passes such bounds or when its surface is glazed since a reflection can reach anything.
+	// returns false without rendering when the dirty region is too large to be worth it
+	bool render_region(const std::vector<aabb>& changed, const std::vector<int>& moved)
+	{
+		trace_scope scope{"region"};
+		size_t pixels{(size_t)width * height};
+		std::vector<unsigned char> dirty(pixels);
+		std::vector<unsigned char> is_moved(geo.size());
+		for (int obj : moved)
+		{
+			is_moved[obj] = 1;
+		}
+		for (const aabb& box : changed)
+		{
+			glm::ivec4 rect{screen_bounds(box)};
+			for (int i{rect.y}; i < rect.w; i++)
+			{
+				std::fill(dirty.begin() + (size_t)i * width + rect.x, dirty.begin() + (size_t)i * width + rect.z, 1);
+			}
+		}
+
+		std::atomic<size_t> count{};
+		pool.run(height, [&](int i, int)
+		{
+			size_t row{};
+			for (int j{}; j < width; j++)
+			{
+				size_t idx{(size_t)i * width + j};
+				const hit_information& hit{cache.hits[idx]};
+				if (!dirty[idx] && hit.hits != 0)
+				{
+					dirty[idx] = is_moved[hit.obj] || materials[geo.mat[hit.obj]].glazed || shadowed_by(cache.rays[idx], hit, changed);
+				}
+				row += dirty[idx];
+			}
+			count += row;
+		});
+		if (count > max_region * pixels)
+		{
+			return false;
+		}
+
+		std::vector<char> known(point_lights.size());
+		std::atomic<bool> first{true};
+		pool.run(height, [&](int i, int)
+		{
+			for (int j{}; j < width; j++)
+			{
+				size_t idx{(size_t)i * width + j};
+				if (!dirty[idx])
+				{
+					continue;
+				}
+				ray r{cam.generate_ray(j, i)};
+				hit_information hit{calculate_hit(r)};
+				counters.local().primary++;
+				cache.store(j, i, r, hit);
+				glm::vec3 color{};
+				if (hit.hits != 0)
+				{
+					color = shader(r, hit, cache.shadows_valid ? cached_shadows(idx, r, hit, known) : nullptr, 0);
+				}
+				fill(j, i, 1, color);
+			}
+			if (first.exchange(false))
+			{
+				first_tile = std::chrono::steady_clock::now();
+			}
+		});
+		// the layers were computed from the previous hits
+		cache.version++;
+		cache.shade(shading(), point_lights);
+		return true;
+	}
+
+	// pixel rectangle (x0, y0, x1, y1) covering the projection of box, the whole image when part of it lies behind the eye
+	glm::ivec4 screen_bounds(const aabb& box) const
+	{
+		glm::vec2 lo{INF, INF};
+		glm::vec2 hi{-INF, -INF};
+		for (int c{}; c < 8; c++)
+		{
+			glm::vec3 corner{c & 1 ? box.max.x : box.min.x, c & 2 ? box.max.y : box.min.y, c & 4 ? box.max.z : box.min.z};
+			glm::vec3 q{corner - cam.e};
+			glm::vec2 uv{glm::dot(q, cam.u), glm::dot(q, cam.v)};
+			if (!cam.ortho)
+			{
+				float depth{-glm::dot(q, cam.w)};
+				if (depth <= 1e-4f)
+				{
+					return glm::ivec4{0, 0, width, height};
+				}
+				uv *= cam.d / depth;
+			}
+			// inverse of the image plane coordinates in generate_ray
+			glm::vec2 pixel{(uv.x - cam.l) / (cam.r - cam.l) * width - 0.5f, (uv.y - cam.b) / (cam.t - cam.b) * height - 0.5f};
+			lo = glm::min(lo, pixel);
+			hi = glm::max(hi, pixel);
+		}
+		// a pixel of slack for rounding
+		glm::ivec2 first{glm::clamp(glm::ivec2{glm::floor(lo)} - 1, glm::ivec2{0}, glm::ivec2{width, height})};
+		glm::ivec2 last{glm::clamp(glm::ivec2{glm::ceil(hi)} + 2, glm::ivec2{0}, glm::ivec2{width, height})};
+		return glm::ivec4{first, last};
+	}
+
+	// whether a shadow ray of the hit towards a visible point light passes one of the boxes
+	bool shadowed_by(ray r, const hit_information& hit, const std::vector<aabb>& boxes) const
+	{
+		for (const point_light& l : point_lights)
+		{
+			if (!l.visible)
+			{
+				continue;
+			}
+			float tmax{};
+			ray sr{l.shadow_ray(r, hit, tmax)};
+			glm::vec3 inv_d{1.0f / sr.d};
+			for (const aabb& box : boxes)
+			{
+				float tnear{};
+				if (box.intersect(sr, inv_d, tmax, tnear))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// writes the color of the block whose first pixel is (x, y)
+	void fill(int x, int y, int step, glm::vec3 color)
+	{
+		color = glm::clamp(color, 0.0f, 1.0f);
+		for (int i{y}; i < glm::min(y + step, height); i++)
+		{
+			for (int j{x}; j < glm::min(x + step, width); j++)
+			{
+				int idx = (i * width + j) * 3;
+				image[idx+0] = color.r * 255;
+				image[idx+1] = color.g * 255;
+				image[idx+2] = color.b * 255;
+			}
 		}
 	}
 
@@ -172,16 +1245,27 @@ struct ray_tracer
 		width  = res;
 		height = res;
 		resize(true);
-		update_image();
+		render();
 
-		stbi_flip_vertically_on_write(true);
-		stbi_write_jpg(("images/"+s).c_str(), res, res, 3, image, 100);
+		write_image("images/"+s);
 
 		res = glm::pow(2,res_pow);
 		width  = res;
 		height = res;
 		resize();
-		update_image();
+		render();
+	}
+
+	// writes png when the path ends in .png and jpg otherwise, returns false when stb fails
+	bool write_image(const std::string& path)
+	{
+		trace_scope scope{"encode"};
+		stbi_flip_vertically_on_write(true);
+		if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0)
+		{
+			return stbi_write_png(path.c_str(), width, height, 3, image, width * 3) != 0;
+		}
+		return stbi_write_jpg(path.c_str(), width, height, 3, image, 100) != 0;
 	}
 
 	void lightAnimation(float time)
@@ -212,61 +1296,111 @@ struct ray_tracer
 		image = new unsigned char[width*height*3];
 	}
 
-	glm::vec3 shader(ray& r, hit_information& hit, int& depth)
+	// arbitrary resolution for headless renders, the preview keeps using res_pow
+	void resize(int w, int h)
+	{
+		delete[] image;
+
+		width = w;
+		height = h;
+		cam.nx = width;
+		cam.ny = height;
+		image = new unsigned char[width*height*3];
+	}
+
+	// scenes describe the view for a square image, a wider or taller one widens l and r by its aspect ratio
+	// so it is not stretched. call once after the scene is loaded and resized
+	void fit_view()
 	{
+		float center{(cam.l + cam.r) * 0.5f};
+		float half{(cam.r - cam.l) * 0.5f * width / height};
+		cam.l = center - half;
+		cam.r = center + half;
+	}
+
+	glm::vec3 shader(ray& r, hit_information& hit, const unsigned* shadowed=nullptr, int k=0)
+	{
+		render_counts& c{counters.local()};
+		scoped_timer timer{timers ? &c.shader_ns : nullptr};
 		glm::vec3 color{};
-		for (auto& l : point_lights)
+		walk_path(r, hit, [&](ray& cr, hit_information& ch, int depth, float throughput)
 		{
-			if (l.visible == false)
+			// the shadow rays traced with the packet belong to the first hit only
+			color += throughput * direct(cr, ch, depth == 0 ? shadowed : nullptr, k);
+		});
+		return color;
+	}
+
+	// calls visit(r, hit, depth, throughput) for the hit and the mirror reflections following it, the path
+	// ends after bounce_count reflections, on a material that is not glazed, a miss or a throughput
+	// below min_throughput. the throughput is the product of the k_s before the hit
+	template <typename F>
+	void walk_path(ray& r, hit_information& hit, F&& visit)
+	{
+		float throughput{1.0f};
+		ray current{r};
+		hit_information current_hit{hit};
+		for (int depth{}; ; depth++)
+		{
+			const material& m{materials[geo.mat[current_hit.obj]]};
+			visit(current, current_hit, depth, throughput);
+			throughput *= m.k_s;
+			if (depth > bounce_count || m.glazed == false || throughput < min_throughput)
 			{
-				continue;
+				return;
+			}
+
+			// mirror reflection
+			current = reflection(current, current_hit);
+			current_hit = calculate_hit(current);
+			counters.local().reflection++;
+			if (current_hit.hits == 0)
+			{
+				return;
 			}
-			color += l.illuminate(r, hit, scene, blinn_phong);
-			// color += l.specular(r, hit);
 		}
-		for (auto& l : ambient_lights)
+	}
+
+	// light arriving at hit straight from the lights. shadowed holds a bit for ray k of a packet per point light
+	// when the shadow rays of the hit were already traced, otherwise they are traced here
+	glm::vec3 direct(ray& r, hit_information& hit, const unsigned* shadowed=nullptr, int k=0)
+	{
+		const material& m{materials[geo.mat[hit.obj]]};
+		glm::vec3 albedo{geo.color[hit.obj]};
+		glm::vec3 color{};
+		for (size_t i{}; i < point_lights.size(); i++)
 		{
+			point_light& l{point_lights[i]};
 			if (l.visible == false)
 			{
 				continue;
 			}
-			color += l.illuminate(r, hit);
-		}
-
-
-		if (depth > bounce_count)
-		{
-			return color;
+			color += l.illuminate(r, hit, m, albedo, [&](ray& sr, float tmax, const hit_information& from)
+			{
+				return shadowed ? (shadowed[i] >> k & 1) != 0 : occluded(sr, tmax, from);
+			}, blinn_phong);
+			// color += l.specular(r, hit);
 		}
-		depth++;
-
-		// mirror reflection
-		if (hit.s->m->glazed == true)
+		for (auto& l : ambient_lights)
 		{
-			glm::vec3 l{glm::normalize(r.d-2.0f*hit.normal*glm::dot(r.d, hit.normal))};
-			ray reflection{r.evaluate(hit.t)+0.1f*l, l};
-			hit_information reflection_hit{calculate_hit(reflection)};
-			float dist{glm::length(r.p - reflection.p)};
-			if (reflection_hit.hits != 0)
+			if (l.visible == false)
 			{
-				color += shader(reflection, reflection_hit, depth)*hit.s->m->k_s;
+				continue;
 			}
+			color += l.illuminate(m, albedo);
 		}
 		return color;
 	}
 
+	ray reflection(ray& r, const hit_information& hit)
+	{
+		glm::vec3 l{glm::normalize(r.d-2.0f*hit.normal*glm::dot(r.d, hit.normal))};
+		return ray{r.evaluate(hit.t)+0.1f*l, l};
+	}
+
 	~ray_tracer()
 	{
 		delete[] image;
-
-		for (auto& obj : scene)
-		{
-			delete obj;
-		}
-		for (auto& obj : materials)
-		{
-			delete obj;
-		}
 	}
 };
 
@@ -0,0 +1,125 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <vector>
+#include <chrono>
+
+#include "thread_pool.h"
+#include "geometry.h"
+
+// what one thread did during the last render, aligned to a cache line so the threads of the pool never write to the same line
+struct alignas(64) render_counts
+{
+	// rays by type
+	unsigned long long primary{};
+	unsigned long long shadow{};
+	unsigned long long reflection{};
+
+	// intersection tests by primitive type, an instance test traverses the bvh of its mesh
+	unsigned long long sphere_tests{};
+	unsigned long long triangle_tests{};
+	unsigned long long instance_tests{};
+
+	// nanoseconds in calculate_hit, shader and the shadow rays while the timers are on,
+	// shader includes the reflection hits and shadow rays it traces
+	unsigned long long hit_ns{};
+	unsigned long long shader_ns{};
+	unsigned long long shadow_ns{};
+
+	render_counts& operator+=(const render_counts& o)
+	{
+		primary += o.primary;
+		shadow += o.shadow;
+		reflection += o.reflection;
+		sphere_tests += o.sphere_tests;
+		triangle_tests += o.triangle_tests;
+		instance_tests += o.instance_tests;
+		hit_ns += o.hit_ns;
+		shader_ns += o.shader_ns;
+		shadow_ns += o.shadow_ns;
+		return *this;
+	}
+
+	unsigned long long rays() const
+	{
+		return primary + shadow + reflection;
+	}
+
+	unsigned long long tests() const
+	{
+		return sphere_tests + triangle_tests + instance_tests;
+	}
+
+	void tested(shape k)
+	{
+		(k == shape::sphere ? sphere_tests : k == shape::instance ? instance_tests : triangle_tests)++;
+	}
+};
+
+// debug views that color every pixel by what it cost instead of shading it
+enum class heatmap_view
+{
+	off,
+	tests,	// intersection tests of every primitive type
+	steps,	// bvh stack entries visited
+	rays,	// primary, shadow and reflection rays
+};
+
+inline const char* heatmap_names[]{"off", "tests", "steps", "rays"};
+
+// counts of the last render, every pool thread adds to its own slot and the slots are summed afterwards
+struct render_counters
+{
+	std::vector<render_counts> threads{};
+	render_counts spare{}; // for calls outside a render
+
+	void reset(int thread_count)
+	{
+		threads.assign(thread_count, render_counts{});
+	}
+
+	render_counts& local()
+	{
+		size_t t{(size_t)thread_pool::current};
+		return t < threads.size() ? threads[t] : spare;
+	}
+
+	render_counts total() const
+	{
+		render_counts sum{};
+		for (const render_counts& c : threads)
+		{
+			sum += c;
+		}
+		return sum;
+	}
+};
+
+// adds the time until it goes out of scope to ns, a null ns leaves the clock alone
+struct scoped_timer
+{
+	unsigned long long* ns{};
+	std::chrono::steady_clock::time_point start{};
+
+	scoped_timer(unsigned long long* t)
+		: ns{t}
+	{
+		if (ns)
+		{
+			start = std::chrono::steady_clock::now();
+		}
+	}
+
+	scoped_timer(const scoped_timer&) = delete;
+	scoped_timer& operator=(const scoped_timer&) = delete;
+
+	~scoped_timer()
+	{
+		if (ns)
+		{
+			*ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+};
+
+#endif
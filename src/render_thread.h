@@ -0,0 +1,387 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "raytracer.h"
+
+// what changed in the edited scene since the last submit, camera, lights, materials and settings are always sent
+enum scene_change : unsigned
+{
+	scene_objects = 1,	// color, visibility or material of existing objects, or the materials themselves
+	scene_geometry = 2,	// the object list itself, rebuilds the bvh
+	scene_loaded = 4,	// a new scene whose prepared data and bvh can be reused
+	scene_moved = 8,	// positions or sizes of the objects in geo.moved, refits the bvh
+};
+
+// the new shape of a moved object, handed to the render thread on its own so a move never copies the scene
+struct object_move
+{
+	int obj{};
+	glm::vec3 p[3]{}; // sphere center or triangle corners
+	float radius{};
+	glm::mat4 transform{};
+};
+
+inline void record_moves(const geometry_store& geo, std::vector<object_move>& moves)
+{
+	for (int obj : geo.moved)
+	{
+		object_move m{obj};
+		int i{geo.index[obj]};
+		if (geo.kind[obj] == shape::sphere)
+		{
+			m.p[0] = geo.sphere_center[i];
+			m.radius = geo.sphere_radius[i];
+		}
+		else if (geo.kind[obj] == shape::instance)
+		{
+			m.transform = geo.inst_transform[i];
+		}
+		else
+		{
+			m.p[0] = geo.tri_p1[i];
+			m.p[1] = geo.tri_p2[i];
+			m.p[2] = geo.tri_p3[i];
+		}
+		moves.push_back(m);
+	}
+}
+
+// writes the moved objects into dst and queues them for refitting. unless the object list was just replaced,
+// the bounds every object had in the last image of dst are kept, an unbounded one makes the render thread redraw everything
+inline void apply_moves(ray_tracer& dst, const std::vector<object_move>& moves, bool replaced)
+{
+	geometry_store& geo{dst.geo};
+	for (const object_move& m : moves)
+	{
+		if (!replaced && geo.bounded(m.obj))
+		{
+			dst.moved_from.push_back(geo.bounds(m.obj));
+		}
+		int i{geo.index[m.obj]};
+		if (geo.kind[m.obj] == shape::sphere)
+		{
+			geo.sphere_center[i] = m.p[0];
+			geo.sphere_radius[i] = m.radius;
+		}
+		else if (geo.kind[m.obj] == shape::instance)
+		{
+			geo.inst_transform[i] = m.transform;
+		}
+		else
+		{
+			geo.tri_p1[i] = m.p[0];
+			geo.tri_p2[i] = m.p[1];
+			geo.tri_p3[i] = m.p[2];
+		}
+		geo.touch(m.obj);
+	}
+}
+
+// copies the parts of src that the changes name into dst, the object data is moved when src is a staging copy.
+// moved objects travel separately through apply_moves. returns whether anything the image depends on differs
+// from what dst had before
+inline bool copy_scene(ray_tracer& dst, ray_tracer& src, unsigned changes, bool move)
+{
+	bool changed{changes != 0};
+	if (dst.width != src.width || dst.height != src.height)
+	{
+		dst.resize(src.width, src.height);
+		changed = true;
+	}
+	camera cam{src.cam};
+	cam.nx = dst.width;
+	cam.ny = dst.height;
+	changed = changed || !(dst.cam == cam) || dst.ambient_lights != src.ambient_lights || dst.point_lights != src.point_lights
+		|| !std::equal(dst.materials.begin(), dst.materials.end(), src.materials.begin(), src.materials.end())
+		|| dst.blinn_phong != src.blinn_phong || dst.bounce_count != src.bounce_count
+		|| dst.min_throughput != src.min_throughput || dst.progressive != src.progressive || dst.heatmap != src.heatmap;
+
+	dst.res_pow = src.res_pow;
+	dst.export_res_pow = src.export_res_pow;
+	dst.cam = cam;
+	dst.ambient_lights = src.ambient_lights;
+	dst.point_lights = src.point_lights;
+	dst.materials = src.materials;
+	dst.blinn_phong = src.blinn_phong;
+	dst.bounce_count = src.bounce_count;
+	dst.min_throughput = src.min_throughput;
+	dst.use_bvh = src.use_bvh;
+	dst.wide_bvh = src.wide_bvh;
+	dst.thread_count = src.thread_count;
+	dst.tile_size = src.tile_size;
+	dst.progressive = src.progressive;
+	dst.packets = src.packets;
+	dst.shading_cache = src.shading_cache;
+	dst.relight_layers = src.relight_layers;
+	dst.wavefront = src.wavefront;
+	dst.timers = src.timers;
+	dst.heatmap = src.heatmap;
+	if (changes & (scene_objects | scene_geometry | scene_loaded))
+	{
+		dst.shading_version++;
+	}
+
+	if (changes & (scene_geometry | scene_loaded))
+	{
+		bool prepared{(changes & scene_loaded) && !(changes & scene_geometry) && !src.geo.dirty};
+		if (move)
+		{
+			dst.geo = std::move(src.geo);
+		}
+		else
+		{
+			dst.geo = src.geo;
+		}
+		dst.geo.dirty = !prepared;
+		dst.cache.invalidate();
+		dst.moved_from.clear();
+		if (prepared && move)
+		{
+			dst.accel = std::move(src.accel);
+			dst.unbounded = std::move(src.unbounded);
+			dst.accel_valid = src.accel_valid;
+		}
+		else if (prepared)
+		{
+			dst.accel = src.accel;
+			dst.unbounded = src.unbounded;
+			dst.accel_valid = src.accel_valid;
+		}
+	}
+	else if ((changes & scene_objects) && move)
+	{
+		dst.geo.mat = std::move(src.geo.mat);
+		dst.geo.color = std::move(src.geo.color);
+		dst.geo.visible = std::move(src.geo.visible);
+	}
+	else if (changes & scene_objects)
+	{
+		dst.geo.mat = src.geo.mat;
+		dst.geo.color = src.geo.color;
+		dst.geo.visible = src.geo.visible;
+	}
+	return changed;
+}
+
+// renders on its own thread into a private copy of the scene so the ui never waits for a frame,
+// the ui submits its edited scene and uploads whichever image was completed last.
+// a change restarts the progressive passes at 8x8 blocks, each pass while nothing changes halves the block size
+struct render_thread
+{
+	ray_tracer rt{};
+
+	std::mutex m{};
+	std::condition_variable wake{};
+	std::condition_variable idle{};
+	std::thread worker{};
+	bool stopping{false};
+
+	// latest submitted scene, waiting for the render thread to pick it up
+	ray_tracer pending{};
+	std::vector<object_move> pending_moves{};
+	unsigned pending_changes{};
+	bool has_pending{false};
+	std::string pending_export{};
+	bool rendering{false};
+
+	// block size of the next progressive pass, 0 once the full resolution image is done
+	int step{0};
+	// block size the passes started at after the last change, the passes after it refine
+	int first_step{8};
+
+	// last completed image, copied from rt.image after every pass since the next pass refines rt.image in place
+	unsigned char* front{nullptr};
+	int front_width{};
+	int front_height{};
+	bool fresh{false};
+	double last_build_ms{}; // duration of the bvh build behind the front image
+
+	// what the pass behind the front image traced, its block size and how long it took
+	struct pass_stats
+	{
+		render_counts counts{};
+		int step{};
+		double ms{};
+		unsigned heatmap_max{};
+	};
+	pass_stats last_pass{};
+
+	render_thread()
+	{
+	}
+
+	render_thread(const render_thread&) = delete;
+	render_thread& operator=(const render_thread&) = delete;
+
+	void start()
+	{
+		stop();
+		stopping = false;
+		worker = std::thread([this] { run(); });
+	}
+
+	// copies the edited scene for the next frame, an export path renders and saves that exact scene
+	void submit(ray_tracer& scene, unsigned changes, const std::string& export_path="")
+	{
+		std::lock_guard<std::mutex> lock{m};
+		copy_scene(pending, scene, changes, false);
+		if (changes & (scene_geometry | scene_loaded))
+		{
+			// the copy already has every position
+			pending_moves.clear();
+		}
+		else if (changes & scene_moved)
+		{
+			record_moves(scene.geo, pending_moves);
+		}
+		pending_changes |= changes;
+		has_pending = true;
+		if (!export_path.empty())
+		{
+			pending_export = export_path;
+		}
+		wake.notify_one();
+	}
+
+	// true until the last submitted scene has been rendered at full resolution
+	bool busy()
+	{
+		std::lock_guard<std::mutex> lock{m};
+		return has_pending || rendering || step > 0;
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock{m};
+		idle.wait(lock, [this] { return !has_pending && !rendering && step == 0; });
+	}
+
+	double build_ms()
+	{
+		std::lock_guard<std::mutex> lock{m};
+		return last_build_ms;
+	}
+
+	pass_stats stats()
+	{
+		std::lock_guard<std::mutex> lock{m};
+		return last_pass;
+	}
+
+	// calls upload(image, width, height) when a newer image than the last one presented is ready
+	template <typename F>
+	bool present(F&& upload)
+	{
+		std::lock_guard<std::mutex> lock{m};
+		if (!fresh)
+		{
+			return false;
+		}
+		fresh = false;
+		upload(front, front_width, front_height);
+		return true;
+	}
+
+	void stop()
+	{
+		if (!worker.joinable())
+		{
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock{m};
+			stopping = true;
+		}
+		wake.notify_one();
+		worker.join();
+	}
+
+	~render_thread()
+	{
+		stop();
+		delete[] front;
+	}
+
+private:
+	void run()
+	{
+		tracer::get().name_thread("render thread");
+		while (true)
+		{
+			std::string export_path{};
+			int pass{};
+			{
+				std::unique_lock<std::mutex> lock{m};
+				wake.wait(lock, [this] { return stopping || has_pending || step > 0; });
+				if (stopping)
+				{
+					return;
+				}
+				if (has_pending)
+				{
+					bool changed{copy_scene(rt, pending, pending_changes, true)};
+					apply_moves(rt, pending_moves, pending_changes & (scene_geometry | scene_loaded));
+					if (changed)
+					{
+						// edits that keep the primary hits reshade the cache at full resolution right away
+						step = rt.progressive && !rt.cached() && !rt.patchable() ? 8 : 1;
+						first_step = step;
+					}
+					pending_moves.clear();
+					pending_changes = 0;
+					has_pending = false;
+					std::swap(export_path, pending_export);
+				}
+				if (step == 0 && export_path.empty())
+				{
+					idle.notify_all();
+					continue;
+				}
+				rendering = true;
+				pass = step;
+			}
+
+			auto start{std::chrono::steady_clock::now()};
+			if (!export_path.empty())
+			{
+				rt.export_image(export_path);
+				pass = 0;
+			}
+			else
+			{
+				rt.render(pass, pass < first_step);
+			}
+			double ms{std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()};
+
+			std::lock_guard<std::mutex> lock{m};
+			if (front_width != rt.width || front_height != rt.height)
+			{
+				delete[] front;
+				front = new unsigned char[rt.width * rt.height * 3];
+				front_width = rt.width;
+				front_height = rt.height;
+			}
+			std::copy(rt.image, rt.image + rt.width * rt.height * 3, front);
+			fresh = true;
+			last_build_ms = rt.accel.build_ms;
+			last_pass = pass_stats{rt.counters.total(), pass, ms, rt.heatmap_max};
+			rendering = false;
+			step = pass / 2;
+			if (!has_pending && step == 0)
+			{
+				idle.notify_all();
+			}
+		}
+	}
+};
+
+#endif
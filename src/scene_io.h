@@ -0,0 +1,875 @@
+#ifndef SCENE_IO_H
+#define SCENE_IO_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "raytracer.h"
+#include "snapshot.h"
+
+// text scenes are line based, # starts a comment and colors are 0-1 floats
+//   camera   ex ey ez  lookx looky lookz  depth  ortho
+//   view     l r b t
+//   basis    ux uy uz  vx vy vz  wx wy wz   (optional, overrides the lookat of camera)
+//   material k_a k_d k_s p glazed
+//   sphere   cx cy cz  radius  material  r g b
+//   triangle x1 y1 z1  x2 y2 z2  x3 y3 z3  material  r g b
+//   plane    x1 y1 z1  x2 y2 z2  x3 y3 z3  material  r g b
+//   mesh     material  r g b   (starts mesh n, meshes are numbered from 0 in file order)
+//   meshtri  x1 y1 z1  x2 y2 z2  x3 y3 z3   (object space triangle of the last mesh)
+//   instance mesh  m00 m01 m02 m03  m10 m11 m12 m13  m20 m21 m22 m23  [material  r g b]
+//            places a mesh with the rows of an affine transform, material and color default to the mesh's
+//   hidden   (hides the last object above it)
+//   ambient  r g b
+//   light    px py pz  r g b  [start_r start_g start_b  end_r end_g end_b  period]
+// binary scenes start with "RTSB" and store the same records packed, see write_scene_binary
+// snapshots start with "RTSNAP" and are mapped instead of parsed, see snapshot.h
+inline const char* default_scene_text{
+	"camera 1.5 4 -2  -0.5 1.5 0  5 0\n"
+	"material 0.5 0.4 0.8 32 1\n"
+	"material 0.25 0.4 0.6 100 1\n"
+	"material 0.4 0.4 0.25 16 0\n"
+	"material 0.5 0.2 0.2 8 0\n"
+	"triangle 1 1 -1  -1 1 -1  0 1 1  0  1 0 0\n"
+	"triangle 0 3 0  1 1 -1  -1 1 -1  0  1 0 0\n"
+	"triangle 0 3 0  -1 1 -1  0 1 1  0  1 0 0\n"
+	"triangle 0 3 0  0 1 1  1 1 -1  0  1 0 0\n"
+	"sphere -3 2 0  1.5  1  0.294117647 1 0\n"
+	"sphere -5 2.5 2  0.5  2  0 0.823529412 1\n"
+	"plane -1 0 -1  -1 0 1  1 0 1  3  0.784313725 0.784313725 0.784313725\n"
+	"ambient 1 1 1\n"
+	"light -2 4 -3  1 1 1  0 1 1  1 0 1  1\n"
+	"light -0.5 3.5 0.5  1 1 1  1 1 0  1 0 0.5  1.5\n"
+};
+
+struct scene_load_stats
+{
+	double ms{};
+	size_t bytes{};
+	int objects{};
+	int lights{};
+	bool binary{false};
+	bool mapped{false};
+	std::string error{};
+};
+
+namespace scene_detail
+{
+	constexpr char binary_magic[4]{'R', 'T', 'S', 'B'};
+	constexpr std::uint32_t binary_version{2};
+
+	struct binary_header
+	{
+		char magic[4];
+		std::uint32_t version;
+		std::uint32_t materials;
+		std::uint32_t objects;
+		std::uint32_t spheres;
+		std::uint32_t triangles;
+		std::uint32_t ambient_lights;
+		std::uint32_t point_lights;
+	};
+
+	// follows the header from version 2 on, the mesh and instance records follow the lights
+	struct mesh_header
+	{
+		std::uint32_t meshes;
+		std::uint32_t mesh_triangles;
+		std::uint32_t instances;
+	};
+
+	struct camera_record
+	{
+		float e[3], u[3], v[3], w[3];
+		float d, l, r, b, t;
+		std::uint32_t ortho;
+	};
+
+	struct material_record
+	{
+		float k_a, k_d, k_s;
+		std::int32_t p;
+		std::uint32_t glazed;
+	};
+
+	struct sphere_record
+	{
+		float center[3];
+		float radius;
+		std::int32_t mat;
+		float color[3];
+	};
+
+	struct triangle_record
+	{
+		float p1[3], p2[3], p3[3];
+		std::int32_t mat;
+		float color[3];
+		std::uint32_t plane;
+	};
+
+	struct light_record
+	{
+		float p[3], color[3], start[3], end[3];
+		float period;
+	};
+
+	struct mesh_record
+	{
+		std::uint32_t triangles;
+		std::int32_t mat;
+		float color[3];
+	};
+
+	struct mesh_triangle_record
+	{
+		float p1[3], p2[3], p3[3];
+	};
+
+	struct instance_record
+	{
+		std::int32_t mesh;
+		float transform[12]; // rows of the affine part
+		std::int32_t mat;
+		float color[3];
+	};
+
+	inline glm::vec3 vec(const float* f)
+	{
+		return glm::vec3{f[0], f[1], f[2]};
+	}
+
+	inline void put(float* f, glm::vec3 v)
+	{
+		f[0] = v.x;
+		f[1] = v.y;
+		f[2] = v.z;
+	}
+
+	// 12 floats, the three rows of an affine transform
+	inline glm::mat4 affine(const float* f)
+	{
+		glm::mat4 m{1.0f};
+		for (int r{}; r < 3; r++)
+		{
+			for (int c{}; c < 4; c++)
+			{
+				m[c][r] = f[r * 4 + c];
+			}
+		}
+		return m;
+	}
+
+	inline void put_affine(float* f, const glm::mat4& m)
+	{
+		for (int r{}; r < 3; r++)
+		{
+			for (int c{}; c < 4; c++)
+			{
+				f[r * 4 + c] = m[c][r];
+			}
+		}
+	}
+
+	inline bool read_file(const std::string& path, std::vector<char>& data)
+	{
+		std::FILE* f{std::fopen(path.c_str(), "rb")};
+		if (!f)
+		{
+			return false;
+		}
+		long size{std::fseek(f, 0, SEEK_END) == 0 ? std::ftell(f) : -1};
+		if (size < 0 || std::fseek(f, 0, SEEK_SET) != 0)
+		{
+			std::fclose(f);
+			return false;
+		}
+		data.resize(size + 1);
+		bool ok{std::fread(data.data(), 1, size, f) == (size_t)size};
+		data[size] = '\0';
+		std::fclose(f);
+		return ok;
+	}
+
+	// reads floats straight out of the buffer, a line that runs out of numbers sets ok to false
+	struct line_reader
+	{
+		const char* p{};
+		bool ok{true};
+
+		float f()
+		{
+			if (!more())
+			{
+				ok = false;
+				return 0.0f;
+			}
+			char* end{};
+			float v{std::strtof(p, &end)};
+			ok = ok && end != p;
+			p = end;
+			return v;
+		}
+
+		glm::vec3 v3()
+		{
+			float x{f()};
+			float y{f()};
+			float z{f()};
+			return glm::vec3{x, y, z};
+		}
+
+		int i()
+		{
+			return (int)f();
+		}
+
+		bool more()
+		{
+			while (*p == ' ' || *p == '\t' || *p == '\r')
+			{
+				p++;
+			}
+			return *p != '\n' && *p != '\0' && *p != '#';
+		}
+	};
+
+	inline void reset(ray_tracer& rt)
+	{
+		rt.geo.clear();
+		rt.materials.clear();
+		rt.accel.clear();
+		rt.unbounded.clear();
+		rt.accel_valid = false;
+		rt.snapshot.reset();
+		rt.ambient_lights.clear();
+		rt.point_lights.clear();
+		// a scene without camera records gets the default view, not the one of the previous scene
+		camera cam{};
+		cam.nx = rt.cam.nx;
+		cam.ny = rt.cam.ny;
+		rt.cam = cam;
+	}
+
+	inline bool peek(const std::string& path, char* head, size_t count)
+	{
+		std::FILE* f{std::fopen(path.c_str(), "rb")};
+		if (!f)
+		{
+			return false;
+		}
+		bool ok{std::fread(head, 1, count, f) == count};
+		std::fclose(f);
+		return ok;
+	}
+
+	inline bool parse_text(ray_tracer& rt, const char* text, scene_load_stats& stats)
+	{
+		reset(rt);
+		int line{};
+		const char* p{text};
+		while (*p)
+		{
+			line++;
+			while (*p == ' ' || *p == '\t' || *p == '\r')
+			{
+				p++;
+			}
+			const char* word{p};
+			while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+			{
+				p++;
+			}
+			std::string_view key{word, (size_t)(p - word)};
+			line_reader in{p};
+
+			if (key.empty() || key[0] == '#')
+			{
+				in.p = word;
+			}
+			else if (key == "sphere")
+			{
+				glm::vec3 c{in.v3()};
+				float r{in.f()};
+				int m{in.i()};
+				rt.geo.add_sphere(c, r, m, in.v3());
+			}
+			else if (key == "triangle" || key == "plane")
+			{
+				glm::vec3 p1{in.v3()};
+				glm::vec3 p2{in.v3()};
+				glm::vec3 p3{in.v3()};
+				int m{in.i()};
+				rt.geo.add_triangle(p1, p2, p3, m, in.v3(), key == "plane");
+			}
+			else if (key == "mesh")
+			{
+				int m{in.i()};
+				rt.geo.add_mesh(m, in.v3());
+			}
+			else if (key == "meshtri")
+			{
+				glm::vec3 p1{in.v3()};
+				glm::vec3 p2{in.v3()};
+				glm::vec3 p3{in.v3()};
+				if (rt.geo.meshes() == 0)
+				{
+					stats.error = "line " + std::to_string(line) + ": meshtri before any mesh";
+					return false;
+				}
+				rt.geo.add_mesh_triangle(p1, p2, p3);
+			}
+			else if (key == "instance")
+			{
+				int mesh{in.i()};
+				float transform[12]{};
+				for (float& f : transform)
+				{
+					f = in.f();
+				}
+				if (mesh < 0 || mesh >= rt.geo.meshes())
+				{
+					stats.error = "line " + std::to_string(line) + ": unknown mesh " + std::to_string(mesh);
+					return false;
+				}
+				int obj{rt.geo.add_instance(mesh, affine(transform))};
+				if (in.more())
+				{
+					rt.geo.mat[obj] = in.i();
+					rt.geo.color[obj] = in.v3();
+				}
+			}
+			else if (key == "hidden")
+			{
+				if (rt.geo.size() == 0)
+				{
+					stats.error = "line " + std::to_string(line) + ": hidden before any object";
+					return false;
+				}
+				rt.geo.visible[rt.geo.size() - 1] = false;
+			}
+			else if (key == "material")
+			{
+				material mat{};
+				mat.k_a = in.f();
+				mat.k_d = in.f();
+				mat.k_s = in.f();
+				mat.p = in.i();
+				mat.glazed = in.i() != 0;
+				rt.materials.push_back(mat);
+			}
+			else if (key == "light")
+			{
+				point_light l{in.v3()};
+				l.color = in.v3();
+				if (in.more())
+				{
+					l.animationStartColor = in.v3();
+					l.animationEndColor = in.v3();
+					l.period = in.f();
+				}
+				rt.point_lights.push_back(l);
+			}
+			else if (key == "ambient")
+			{
+				ambient_light l{};
+				l.color = in.v3();
+				rt.ambient_lights.push_back(l);
+			}
+			else if (key == "camera")
+			{
+				rt.cam.e = in.v3();
+				glm::vec3 target{in.v3()};
+				rt.cam.d = in.f();
+				rt.cam.ortho = in.i() != 0;
+				rt.lookat(target);
+			}
+			else if (key == "basis")
+			{
+				rt.cam.u = in.v3();
+				rt.cam.v = in.v3();
+				rt.cam.w = in.v3();
+			}
+			else if (key == "view")
+			{
+				rt.cam.l = in.f();
+				rt.cam.r = in.f();
+				rt.cam.b = in.f();
+				rt.cam.t = in.f();
+			}
+			else
+			{
+				stats.error = "line " + std::to_string(line) + ": unknown record " + std::string{key};
+				return false;
+			}
+
+			if (!key.empty() && key[0] != '#' && (!in.ok || in.more()))
+			{
+				stats.error = "line " + std::to_string(line) + ": malformed " + std::string{key};
+				return false;
+			}
+			p = in.p;
+			while (*p && *p != '\n')
+			{
+				p++;
+			}
+			if (*p == '\n')
+			{
+				p++;
+			}
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool take(const char*& p, const char* end, T* out, size_t count)
+	{
+		size_t bytes{sizeof(T) * count};
+		if ((size_t)(end - p) < bytes)
+		{
+			return false;
+		}
+		std::memcpy(out, p, bytes);
+		p += bytes;
+		return true;
+	}
+
+	inline bool parse_binary(ray_tracer& rt, const char* data, size_t size, scene_load_stats& stats)
+	{
+		reset(rt);
+		const char* p{data};
+		const char* end{data + size};
+		binary_header h{};
+		mesh_header mh{};
+		if (!take(p, end, &h, 1) || std::memcmp(h.magic, binary_magic, 4) != 0 || h.version < 1 || h.version > binary_version
+			|| (h.version >= 2 && !take(p, end, &mh, 1)))
+		{
+			stats.error = "not a version 1 to " + std::to_string(binary_version) + " binary scene";
+			return false;
+		}
+
+		// check the size up front so a corrupt header cannot trigger huge allocations
+		size_t expected{(size_t)(p - data) + sizeof(camera_record)
+			+ sizeof(material_record) * (size_t)h.materials
+			+ 2 * (size_t)h.objects
+			+ sizeof(sphere_record) * (size_t)h.spheres
+			+ sizeof(triangle_record) * (size_t)h.triangles
+			+ sizeof(light_record) * ((size_t)h.ambient_lights + h.point_lights)
+			+ sizeof(mesh_record) * (size_t)mh.meshes
+			+ sizeof(mesh_triangle_record) * (size_t)mh.mesh_triangles
+			+ sizeof(instance_record) * (size_t)mh.instances};
+		if (size < expected)
+		{
+			stats.error = "truncated binary scene";
+			return false;
+		}
+
+		camera_record c{};
+		take(p, end, &c, 1);
+		const char* mats{p};
+		const char* kinds{mats + sizeof(material_record) * h.materials};
+		const char* visible{kinds + h.objects};
+		const char* spheres{visible + h.objects};
+		const char* tris{spheres + sizeof(sphere_record) * h.spheres};
+		const char* lights{tris + sizeof(triangle_record) * h.triangles};
+		const char* meshes{lights + sizeof(light_record) * ((size_t)h.ambient_lights + h.point_lights)};
+		const char* mesh_tris{meshes + sizeof(mesh_record) * mh.meshes};
+		const char* instances{mesh_tris + sizeof(mesh_triangle_record) * mh.mesh_triangles};
+
+		rt.cam.e = vec(c.e);
+		rt.cam.u = vec(c.u);
+		rt.cam.v = vec(c.v);
+		rt.cam.w = vec(c.w);
+		rt.cam.d = c.d;
+		rt.cam.l = c.l;
+		rt.cam.r = c.r;
+		rt.cam.b = c.b;
+		rt.cam.t = c.t;
+		rt.cam.ortho = c.ortho != 0;
+
+		rt.materials.reserve(h.materials);
+		for (size_t i{}; i < h.materials; i++)
+		{
+			material_record m{};
+			take(mats, end, &m, 1);
+			rt.materials.push_back(material{m.k_a, m.k_d, m.k_s, m.p, m.glazed != 0});
+		}
+
+		geometry_store& geo{rt.geo};
+		size_t mesh_tri_count{};
+		for (size_t i{}; i < mh.meshes; i++)
+		{
+			mesh_record m{};
+			take(meshes, end, &m, 1);
+			mesh_tri_count += m.triangles;
+			if (mesh_tri_count > mh.mesh_triangles)
+			{
+				stats.error = "mesh table does not match the mesh triangles";
+				return false;
+			}
+			geo.add_mesh(m.mat, vec(m.color));
+			for (size_t k{}; k < m.triangles; k++)
+			{
+				mesh_triangle_record t{};
+				take(mesh_tris, end, &t, 1);
+				geo.add_mesh_triangle(vec(t.p1), vec(t.p2), vec(t.p3));
+			}
+		}
+
+		geo.kind.reserve(h.objects);
+		geo.sphere_center.reserve(h.spheres);
+		geo.tri_p1.reserve(h.triangles);
+		size_t si{};
+		size_t ti{};
+		size_t ii{};
+		for (size_t i{}; i < h.objects; i++)
+		{
+			if (kinds[i] == (char)shape::sphere && si++ < h.spheres)
+			{
+				sphere_record s{};
+				take(spheres, end, &s, 1);
+				geo.add_sphere(vec(s.center), s.radius, s.mat, vec(s.color));
+			}
+			else if (kinds[i] == (char)shape::triangle && ti++ < h.triangles)
+			{
+				triangle_record t{};
+				take(tris, end, &t, 1);
+				geo.add_triangle(vec(t.p1), vec(t.p2), vec(t.p3), t.mat, vec(t.color), t.plane != 0);
+			}
+			else if (kinds[i] == (char)shape::instance && ii++ < mh.instances)
+			{
+				instance_record r{};
+				take(instances, end, &r, 1);
+				if (r.mesh < 0 || r.mesh >= geo.meshes())
+				{
+					stats.error = "instance of unknown mesh " + std::to_string(r.mesh);
+					return false;
+				}
+				int obj{geo.add_instance(r.mesh, affine(r.transform))};
+				geo.mat[obj] = r.mat;
+				geo.color[obj] = vec(r.color);
+			}
+			else
+			{
+				stats.error = "object table does not match the shape arrays";
+				return false;
+			}
+			geo.visible.back() = visible[i];
+		}
+
+		for (size_t i{}; i < h.ambient_lights; i++)
+		{
+			light_record l{};
+			take(lights, end, &l, 1);
+			ambient_light a{};
+			a.color = vec(l.color);
+			rt.ambient_lights.push_back(a);
+		}
+		for (size_t i{}; i < h.point_lights; i++)
+		{
+			light_record l{};
+			take(lights, end, &l, 1);
+			point_light pl{vec(l.p), vec(l.start), vec(l.end), l.period};
+			pl.color = vec(l.color);
+			rt.point_lights.push_back(pl);
+		}
+		return true;
+	}
+
+	// material indices outside the material list would crash the shader
+	inline bool validate(ray_tracer& rt, scene_load_stats& stats)
+	{
+		if (rt.materials.empty())
+		{
+			rt.materials.push_back(material{});
+		}
+		for (const column<int>* mats : {&rt.geo.mat, &rt.geo.mesh_mat})
+		{
+			for (int m : *mats)
+			{
+				if (m < 0 || m >= rt.materials.size())
+				{
+					stats.error = "material index " + std::to_string(m) + " out of range";
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
+
+// replaces the scene of rt with the one in text, used for the built-in default scene
+inline bool load_scene_text(ray_tracer& rt, const char* text, scene_load_stats& stats)
+{
+	auto start{std::chrono::steady_clock::now()};
+	stats = scene_load_stats{};
+	stats.bytes = std::strlen(text);
+	bool ok{scene_detail::parse_text(rt, text, stats) && scene_detail::validate(rt, stats)};
+	stats.objects = rt.geo.size();
+	stats.lights = rt.point_lights.size();
+	stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return ok;
+}
+
+// replaces the scene of rt with a text, binary or snapshot scene file, the format is picked from the file header
+inline bool load_scene(ray_tracer& rt, const std::string& path, scene_load_stats& stats)
+{
+	auto start{std::chrono::steady_clock::now()};
+	stats = scene_load_stats{};
+
+	// a directory opens and seeks like a file but reports a meaningless size
+	std::error_code ec{};
+	if (!std::filesystem::is_regular_file(path, ec))
+	{
+		stats.error = std::filesystem::exists(path, ec) ? "not a regular file" : "cannot read " + path;
+		return false;
+	}
+
+	char head[8]{};
+	if (scene_detail::peek(path, head, sizeof(head)) && is_snapshot(head, sizeof(head)))
+	{
+		stats.binary = true;
+		stats.mapped = true;
+		scene_detail::reset(rt);
+		bool ok{load_snapshot(rt, path, stats.error) && scene_detail::validate(rt, stats)};
+		stats.bytes = rt.snapshot ? rt.snapshot->size : 0;
+		stats.objects = rt.geo.size();
+		stats.lights = rt.point_lights.size();
+		stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return ok;
+	}
+
+	std::vector<char> data{};
+	if (!scene_detail::read_file(path, data))
+	{
+		stats.error = "cannot read " + path;
+		return false;
+	}
+	stats.bytes = data.size() - 1;
+	stats.binary = stats.bytes >= 4 && std::memcmp(data.data(), scene_detail::binary_magic, 4) == 0;
+	bool ok{stats.binary
+		? scene_detail::parse_binary(rt, data.data(), stats.bytes, stats)
+		: scene_detail::parse_text(rt, data.data(), stats)};
+	ok = ok && scene_detail::validate(rt, stats);
+	stats.objects = rt.geo.size();
+	stats.lights = rt.point_lights.size();
+	stats.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return ok;
+}
+
+inline bool write_scene_binary(ray_tracer& rt, const std::string& path)
+{
+	using namespace scene_detail;
+	const geometry_store& geo{rt.geo};
+
+	binary_header h{};
+	std::memcpy(h.magic, binary_magic, 4);
+	h.version = binary_version;
+	h.materials = rt.materials.size();
+	h.objects = geo.size();
+	h.spheres = geo.sphere_center.size();
+	h.triangles = geo.tri_p1.size();
+	h.ambient_lights = rt.ambient_lights.size();
+	h.point_lights = rt.point_lights.size();
+	mesh_header mh{};
+	mh.meshes = geo.meshes();
+	mh.mesh_triangles = geo.mesh_p1.size();
+	mh.instances = geo.inst_mesh.size();
+
+	camera_record c{};
+	put(c.e, rt.cam.e);
+	put(c.u, rt.cam.u);
+	put(c.v, rt.cam.v);
+	put(c.w, rt.cam.w);
+	c.d = rt.cam.d;
+	c.l = rt.cam.l;
+	c.r = rt.cam.r;
+	c.b = rt.cam.b;
+	c.t = rt.cam.t;
+	c.ortho = rt.cam.ortho;
+
+	std::vector<material_record> mats{};
+	for (auto& m : rt.materials)
+	{
+		mats.push_back(material_record{m.k_a, m.k_d, m.k_s, m.p, m.glazed});
+	}
+	std::vector<unsigned char> kinds{};
+	for (shape k : geo.kind)
+	{
+		kinds.push_back((unsigned char)k);
+	}
+	std::vector<sphere_record> spheres(geo.sphere_center.size());
+	for (size_t i{}; i < spheres.size(); i++)
+	{
+		put(spheres[i].center, geo.sphere_center[i]);
+		spheres[i].radius = geo.sphere_radius[i];
+		spheres[i].mat = geo.mat[geo.sphere_object[i]];
+		put(spheres[i].color, geo.color[geo.sphere_object[i]]);
+	}
+	std::vector<triangle_record> tris(geo.tri_p1.size());
+	for (size_t i{}; i < tris.size(); i++)
+	{
+		put(tris[i].p1, geo.tri_p1[i]);
+		put(tris[i].p2, geo.tri_p2[i]);
+		put(tris[i].p3, geo.tri_p3[i]);
+		tris[i].mat = geo.mat[geo.tri_object[i]];
+		put(tris[i].color, geo.color[geo.tri_object[i]]);
+		tris[i].plane = geo.tri_plane[i];
+	}
+	std::vector<light_record> ambient(rt.ambient_lights.size());
+	for (size_t i{}; i < ambient.size(); i++)
+	{
+		put(ambient[i].color, rt.ambient_lights[i].color);
+	}
+	std::vector<light_record> lights(rt.point_lights.size());
+	for (size_t i{}; i < lights.size(); i++)
+	{
+		point_light& l{rt.point_lights[i]};
+		put(lights[i].p, l.p);
+		put(lights[i].color, l.color);
+		put(lights[i].start, l.animationStartColor);
+		put(lights[i].end, l.animationEndColor);
+		lights[i].period = l.period;
+	}
+	std::vector<mesh_record> meshes(geo.meshes());
+	for (size_t i{}; i < meshes.size(); i++)
+	{
+		meshes[i].triangles = geo.mesh_count[i];
+		meshes[i].mat = geo.mesh_mat[i];
+		put(meshes[i].color, geo.mesh_color[i]);
+	}
+	std::vector<mesh_triangle_record> mesh_tris(geo.mesh_p1.size());
+	for (size_t i{}; i < mesh_tris.size(); i++)
+	{
+		put(mesh_tris[i].p1, geo.mesh_p1[i]);
+		put(mesh_tris[i].p2, geo.mesh_p2[i]);
+		put(mesh_tris[i].p3, geo.mesh_p3[i]);
+	}
+	std::vector<instance_record> instances(geo.inst_mesh.size());
+	for (size_t i{}; i < instances.size(); i++)
+	{
+		instances[i].mesh = geo.inst_mesh[i];
+		put_affine(instances[i].transform, geo.inst_transform[i]);
+		instances[i].mat = geo.mat[geo.inst_object[i]];
+		put(instances[i].color, geo.color[geo.inst_object[i]]);
+	}
+
+	std::FILE* f{std::fopen(path.c_str(), "wb")};
+	if (!f)
+	{
+		return false;
+	}
+	bool ok{std::fwrite(&h, sizeof(h), 1, f) == 1
+		&& std::fwrite(&mh, sizeof(mh), 1, f) == 1
+		&& std::fwrite(&c, sizeof(c), 1, f) == 1
+		&& std::fwrite(mats.data(), sizeof(material_record), mats.size(), f) == mats.size()
+		&& std::fwrite(kinds.data(), 1, kinds.size(), f) == kinds.size()
+		&& std::fwrite(geo.visible.data(), 1, geo.visible.size(), f) == geo.visible.size()
+		&& std::fwrite(spheres.data(), sizeof(sphere_record), spheres.size(), f) == spheres.size()
+		&& std::fwrite(tris.data(), sizeof(triangle_record), tris.size(), f) == tris.size()
+		&& std::fwrite(ambient.data(), sizeof(light_record), ambient.size(), f) == ambient.size()
+		&& std::fwrite(lights.data(), sizeof(light_record), lights.size(), f) == lights.size()
+		&& std::fwrite(meshes.data(), sizeof(mesh_record), meshes.size(), f) == meshes.size()
+		&& std::fwrite(mesh_tris.data(), sizeof(mesh_triangle_record), mesh_tris.size(), f) == mesh_tris.size()
+		&& std::fwrite(instances.data(), sizeof(instance_record), instances.size(), f) == instances.size()};
+	return std::fclose(f) == 0 && ok;
+}
+
+inline bool write_scene_text(ray_tracer& rt, const std::string& path)
+{
+	std::FILE* f{std::fopen(path.c_str(), "w")};
+	if (!f)
+	{
+		return false;
+	}
+	const geometry_store& geo{rt.geo};
+	auto v3{[&](glm::vec3 v)
+	{
+		std::fprintf(f, "  %.9g %.9g %.9g", v.x, v.y, v.z);
+	}};
+
+	// the lookat point is one unit along -w, basis keeps the exact vectors
+	std::fprintf(f, "camera");
+	v3(rt.cam.e);
+	v3(rt.cam.e - rt.cam.w);
+	std::fprintf(f, "  %.9g %d\n", rt.cam.d, (int)rt.cam.ortho);
+	std::fprintf(f, "basis");
+	v3(rt.cam.u);
+	v3(rt.cam.v);
+	v3(rt.cam.w);
+	std::fprintf(f, "\n");
+	std::fprintf(f, "view %.9g %.9g %.9g %.9g\n", rt.cam.l, rt.cam.r, rt.cam.b, rt.cam.t);
+	for (auto& m : rt.materials)
+	{
+		std::fprintf(f, "material %.9g %.9g %.9g %d %d\n", m.k_a, m.k_d, m.k_s, m.p, (int)m.glazed);
+	}
+	for (int m{}; m < geo.meshes(); m++)
+	{
+		std::fprintf(f, "mesh  %d", geo.mesh_mat[m]);
+		v3(geo.mesh_color[m]);
+		std::fprintf(f, "\n");
+		for (int t{geo.mesh_first[m]}; t < geo.mesh_first[m] + geo.mesh_count[m]; t++)
+		{
+			std::fprintf(f, "meshtri");
+			v3(geo.mesh_p1[t]);
+			v3(geo.mesh_p2[t]);
+			v3(geo.mesh_p3[t]);
+			std::fprintf(f, "\n");
+		}
+	}
+	for (int i{}; i < geo.size(); i++)
+	{
+		int idx{geo.index[i]};
+		if (geo.kind[i] == shape::sphere)
+		{
+			std::fprintf(f, "sphere");
+			v3(geo.sphere_center[idx]);
+			std::fprintf(f, "  %.9g", geo.sphere_radius[idx]);
+		}
+		else if (geo.kind[i] == shape::instance)
+		{
+			float transform[12]{};
+			scene_detail::put_affine(transform, geo.inst_transform[idx]);
+			std::fprintf(f, "instance %d", geo.inst_mesh[idx]);
+			for (int r{}; r < 3; r++)
+			{
+				std::fprintf(f, "  %.9g %.9g %.9g %.9g", transform[r * 4], transform[r * 4 + 1], transform[r * 4 + 2], transform[r * 4 + 3]);
+			}
+		}
+		else
+		{
+			std::fprintf(f, geo.tri_plane[idx] ? "plane" : "triangle");
+			v3(geo.tri_p1[idx]);
+			v3(geo.tri_p2[idx]);
+			v3(geo.tri_p3[idx]);
+		}
+		std::fprintf(f, "  %d", geo.mat[i]);
+		v3(geo.color[i]);
+		std::fprintf(f, geo.visible[i] ? "\n" : "\nhidden\n");
+	}
+	for (auto& l : rt.ambient_lights)
+	{
+		std::fprintf(f, "ambient");
+		v3(l.color);
+		std::fprintf(f, "\n");
+	}
+	for (auto& l : rt.point_lights)
+	{
+		std::fprintf(f, "light");
+		v3(l.p);
+		v3(l.color);
+		v3(l.animationStartColor);
+		v3(l.animationEndColor);
+		std::fprintf(f, "  %.9g\n", l.period);
+	}
+	return std::fclose(f) == 0;
+}
+
+#endif
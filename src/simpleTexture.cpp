@@ -1,9 +1,9 @@
 #include "application.h"
 
-int main()
+int main(int argc, char** argv)
 {
 	application app{};
-	app.init();
+	app.init(argc > 1 ? argv[1] : "");
 	app.loop();
 	app.close();
 }
\ No newline at end of file
@@ -0,0 +1,441 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "raytracer.h"
+#include "mapped_file.h"
+
+// versioned snapshot of a committed scene: every array is stored 64 byte aligned in the exact layout of the
+// columns, so load_snapshot maps the file and points the columns at it instead of deserializing primitives
+namespace snapshot_detail
+{
+	constexpr char magic[8]{'R', 'T', 'S', 'N', 'A', 'P', '\0', '\0'};
+	constexpr std::uint32_t version{3};
+	constexpr std::uint32_t endian_check{0x01020304};
+	constexpr std::uint64_t alignment{64};
+
+	enum class section : std::uint32_t
+	{
+		kind, index, mat, color, visible,
+		sphere_center, sphere_radius, sphere_object,
+		tri_p1, tri_p2, tri_p3, tri_plane, tri_object, tri_e1, tri_e2, tri_normal,
+		materials, bvh_nodes, bvh_indices, unbounded,
+		ambient_lights, point_lights,
+		mesh_first, mesh_count, mesh_mat, mesh_color, mesh_p1, mesh_p2, mesh_p3, mesh_e1, mesh_e2, mesh_normal,
+		mesh_bvh_sizes, mesh_bvh_nodes, mesh_bvh_indices,
+		inst_mesh, inst_transform, inst_inverse, inst_object,
+		bvh_wide, mesh_bvh_wide_sizes, mesh_bvh_wide,
+		count
+	};
+
+	struct section_entry
+	{
+		std::uint64_t offset;
+		std::uint64_t count;
+		std::uint32_t element_size;
+		std::uint32_t reserved;
+	};
+
+	struct header
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t endian;
+		std::uint32_t camera_size;
+		std::uint32_t has_bvh;
+		camera cam;
+		section_entry sections[(int)section::count];
+	};
+
+	struct writer
+	{
+		header h{};
+		std::vector<std::pair<const void*, size_t>> blocks{};
+		std::uint64_t offset{(sizeof(header) + alignment - 1) / alignment * alignment};
+
+		template <typename T>
+		void add(section s, const T* data, size_t count)
+		{
+			h.sections[(int)s] = section_entry{offset, count, sizeof(T), 0};
+			blocks.resize((int)section::count);
+			blocks[(int)s] = {data, sizeof(T) * count};
+			offset = (offset + sizeof(T) * count + alignment - 1) / alignment * alignment;
+		}
+
+		template <typename T>
+		void add(section s, const column<T>& c)
+		{
+			add(s, c.data(), c.size());
+		}
+	};
+
+	template <typename T>
+	bool attach(const header& h, mapped_file& file, section s, column<T>& c, std::string& error)
+	{
+		const section_entry& e{h.sections[(int)s]};
+		if (e.element_size != sizeof(T) || e.offset % alignment != 0 || e.offset > file.size
+			|| e.count > (file.size - e.offset) / sizeof(T))
+		{
+			error = "snapshot section " + std::to_string((int)s) + " is out of bounds or has the wrong layout";
+			return false;
+		}
+		c.attach((T*)(file.data + e.offset), e.count);
+		return true;
+	}
+
+	// every primitive id and leaf range of a stored tree has to lie inside its arrays, children have to come after
+	// their parent so the tree has no cycles, and it may not be deeper than the traversal stacks hold
+	inline bool valid_tree(const bvh& b, size_t prims)
+	{
+		for (int id : b.indices)
+		{
+			if (id < 0 || (size_t)id >= prims)
+			{
+				return false;
+			}
+		}
+		auto leaf{[&](int first, int count)
+		{
+			return first >= 0 && (size_t)first <= b.indices.size() && (size_t)count <= b.indices.size() - first;
+		}};
+
+		std::vector<int> depth(b.nodes.size());
+		for (size_t i{}; i < b.nodes.size(); i++)
+		{
+			const bvh_node& n{b.nodes[i]};
+			if (depth[i] > bvh::max_depth || n.count < 0 || (n.count > 0 && !leaf(n.first, n.count))
+				|| (n.count == 0 && (n.first <= (int)i || (size_t)n.first + 1 >= b.nodes.size())))
+			{
+				return false;
+			}
+			if (n.count == 0)
+			{
+				depth[n.first] = std::max(depth[n.first], depth[i] + 1);
+				depth[n.first + 1] = std::max(depth[n.first + 1], depth[i] + 1);
+			}
+		}
+
+		// lanes with a negative count are unused and never entered
+		std::vector<int> wide_depth(b.wide_nodes.size());
+		for (size_t w{}; w < b.wide_nodes.size(); w++)
+		{
+			const wide_node& n{b.wide_nodes[w]};
+			if (wide_depth[w] > bvh::max_depth)
+			{
+				return false;
+			}
+			for (int lane{}; lane < 4; lane++)
+			{
+				int child{n.child[lane]};
+				if ((n.count[lane] > 0 && !leaf(child, n.count[lane]))
+					|| (n.count[lane] == 0 && (child <= (int)w || (size_t)child >= b.wide_nodes.size())))
+				{
+					return false;
+				}
+				if (n.count[lane] == 0)
+				{
+					wide_depth[child] = std::max(wide_depth[child], wide_depth[w] + 1);
+				}
+			}
+		}
+		return true;
+	}
+
+	// the kind and index of every object have to name an entry of its shape arrays that points back at it
+	inline bool valid_objects(const geometry_store& geo)
+	{
+		for (int obj{}; obj < geo.size(); obj++)
+		{
+			int i{geo.index[obj]};
+			const column<int>* owner{};
+			switch (geo.kind[obj])
+			{
+			case shape::sphere:
+				owner = &geo.sphere_object;
+				break;
+			case shape::triangle:
+				owner = &geo.tri_object;
+				break;
+			case shape::instance:
+				owner = &geo.inst_object;
+				break;
+			default:
+				return false;
+			}
+			if (i < 0 || (size_t)i >= owner->size() || (*owner)[i] != obj)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+inline bool is_snapshot(const char* data, size_t size)
+{
+	return size >= 8 && std::memcmp(data, snapshot_detail::magic, 8) == 0;
+}
+
+// commits the scene first so the prepared triangles and the bvh are stored with it,
+// the bottom level bvhs of the meshes are stored back to back with their node counts
+inline bool write_snapshot(ray_tracer& rt, const std::string& path)
+{
+	using namespace snapshot_detail;
+	bool use_bvh{rt.use_bvh};
+	rt.use_bvh = true;
+	rt.commit();
+	rt.use_bvh = use_bvh;
+
+	const geometry_store& geo{rt.geo};
+	writer w{};
+	std::memcpy(w.h.magic, magic, 8);
+	w.h.version = version;
+	w.h.endian = endian_check;
+	w.h.camera_size = sizeof(camera);
+	w.h.has_bvh = rt.accel_valid;
+	w.h.cam = rt.cam;
+	w.add(section::kind, geo.kind);
+	w.add(section::index, geo.index);
+	w.add(section::mat, geo.mat);
+	w.add(section::color, geo.color);
+	w.add(section::visible, geo.visible);
+	w.add(section::sphere_center, geo.sphere_center);
+	w.add(section::sphere_radius, geo.sphere_radius);
+	w.add(section::sphere_object, geo.sphere_object);
+	w.add(section::tri_p1, geo.tri_p1);
+	w.add(section::tri_p2, geo.tri_p2);
+	w.add(section::tri_p3, geo.tri_p3);
+	w.add(section::tri_plane, geo.tri_plane);
+	w.add(section::tri_object, geo.tri_object);
+	w.add(section::tri_e1, geo.tri_e1);
+	w.add(section::tri_e2, geo.tri_e2);
+	w.add(section::tri_normal, geo.tri_normal);
+	w.add(section::materials, rt.materials);
+	w.add(section::bvh_nodes, rt.accel.nodes);
+	w.add(section::bvh_indices, rt.accel.indices);
+	w.add(section::unbounded, rt.unbounded);
+	w.add(section::ambient_lights, rt.ambient_lights.data(), rt.ambient_lights.size());
+	w.add(section::point_lights, rt.point_lights.data(), rt.point_lights.size());
+	w.add(section::mesh_first, geo.mesh_first);
+	w.add(section::mesh_count, geo.mesh_count);
+	w.add(section::mesh_mat, geo.mesh_mat);
+	w.add(section::mesh_color, geo.mesh_color);
+	w.add(section::mesh_p1, geo.mesh_p1);
+	w.add(section::mesh_p2, geo.mesh_p2);
+	w.add(section::mesh_p3, geo.mesh_p3);
+	w.add(section::mesh_e1, geo.mesh_e1);
+	w.add(section::mesh_e2, geo.mesh_e2);
+	w.add(section::mesh_normal, geo.mesh_normal);
+	std::vector<std::uint64_t> mesh_sizes{};
+	std::vector<bvh_node> mesh_nodes{};
+	std::vector<int> mesh_indices{};
+	std::vector<std::uint64_t> mesh_wide_sizes{};
+	std::vector<wide_node> mesh_wide{};
+	for (const bvh& b : geo.mesh_bvh)
+	{
+		mesh_sizes.push_back(b.nodes.size());
+		mesh_nodes.insert(mesh_nodes.end(), b.nodes.begin(), b.nodes.end());
+		mesh_indices.insert(mesh_indices.end(), b.indices.begin(), b.indices.end());
+		mesh_wide_sizes.push_back(b.wide_nodes.size());
+		mesh_wide.insert(mesh_wide.end(), b.wide_nodes.begin(), b.wide_nodes.end());
+	}
+	w.add(section::mesh_bvh_sizes, mesh_sizes.data(), mesh_sizes.size());
+	w.add(section::mesh_bvh_nodes, mesh_nodes.data(), mesh_nodes.size());
+	w.add(section::mesh_bvh_indices, mesh_indices.data(), mesh_indices.size());
+	w.add(section::inst_mesh, geo.inst_mesh);
+	w.add(section::inst_transform, geo.inst_transform);
+	w.add(section::inst_inverse, geo.inst_inverse);
+	w.add(section::inst_object, geo.inst_object);
+	w.add(section::bvh_wide, rt.accel.wide_nodes);
+	w.add(section::mesh_bvh_wide_sizes, mesh_wide_sizes.data(), mesh_wide_sizes.size());
+	w.add(section::mesh_bvh_wide, mesh_wide.data(), mesh_wide.size());
+
+	std::FILE* f{std::fopen(path.c_str(), "wb")};
+	if (!f)
+	{
+		return false;
+	}
+	static const char zeros[alignment]{};
+	bool ok{std::fwrite(&w.h, sizeof(header), 1, f) == 1};
+	std::uint64_t pos{sizeof(header)};
+	for (int s{}; s < (int)section::count && ok; s++)
+	{
+		const section_entry& e{w.h.sections[s]};
+		ok = std::fwrite(zeros, 1, e.offset - pos, f) == e.offset - pos;
+		ok = ok && std::fwrite(w.blocks[s].first, 1, w.blocks[s].second, f) == w.blocks[s].second;
+		pos = e.offset + w.blocks[s].second;
+	}
+	return std::fclose(f) == 0 && ok;
+}
+
+// maps a snapshot and points the scene columns of rt at it, nothing is copied except the lights
+inline bool load_snapshot(ray_tracer& rt, const std::string& path, std::string& error)
+{
+	using namespace snapshot_detail;
+	auto file{std::make_shared<mapped_file>()};
+	if (!file->open(path))
+	{
+		error = "cannot map " + path;
+		return false;
+	}
+	if (file->size < sizeof(header))
+	{
+		error = "truncated snapshot";
+		return false;
+	}
+	header h{};
+	std::memcpy(&h, file->data, sizeof(header));
+	if (std::memcmp(h.magic, magic, 8) != 0 || h.version != version || h.endian != endian_check || h.camera_size != sizeof(camera))
+	{
+		error = "not a version " + std::to_string(version) + " snapshot for this build";
+		return false;
+	}
+
+	rt.geo.clear();
+	rt.materials.clear();
+	rt.accel.clear();
+	rt.unbounded.clear();
+	rt.snapshot.reset();
+
+	geometry_store& geo{rt.geo};
+	column<ambient_light> ambient{};
+	column<point_light> lights{};
+	column<std::uint64_t> mesh_sizes{};
+	column<bvh_node> mesh_nodes{};
+	column<int> mesh_indices{};
+	column<std::uint64_t> mesh_wide_sizes{};
+	column<wide_node> mesh_wide{};
+	bool ok{attach(h, *file, section::kind, geo.kind, error)
+		&& attach(h, *file, section::index, geo.index, error)
+		&& attach(h, *file, section::mat, geo.mat, error)
+		&& attach(h, *file, section::color, geo.color, error)
+		&& attach(h, *file, section::visible, geo.visible, error)
+		&& attach(h, *file, section::sphere_center, geo.sphere_center, error)
+		&& attach(h, *file, section::sphere_radius, geo.sphere_radius, error)
+		&& attach(h, *file, section::sphere_object, geo.sphere_object, error)
+		&& attach(h, *file, section::tri_p1, geo.tri_p1, error)
+		&& attach(h, *file, section::tri_p2, geo.tri_p2, error)
+		&& attach(h, *file, section::tri_p3, geo.tri_p3, error)
+		&& attach(h, *file, section::tri_plane, geo.tri_plane, error)
+		&& attach(h, *file, section::tri_object, geo.tri_object, error)
+		&& attach(h, *file, section::tri_e1, geo.tri_e1, error)
+		&& attach(h, *file, section::tri_e2, geo.tri_e2, error)
+		&& attach(h, *file, section::tri_normal, geo.tri_normal, error)
+		&& attach(h, *file, section::materials, rt.materials, error)
+		&& attach(h, *file, section::bvh_nodes, rt.accel.nodes, error)
+		&& attach(h, *file, section::bvh_indices, rt.accel.indices, error)
+		&& attach(h, *file, section::unbounded, rt.unbounded, error)
+		&& attach(h, *file, section::ambient_lights, ambient, error)
+		&& attach(h, *file, section::point_lights, lights, error)
+		&& attach(h, *file, section::mesh_first, geo.mesh_first, error)
+		&& attach(h, *file, section::mesh_count, geo.mesh_count, error)
+		&& attach(h, *file, section::mesh_mat, geo.mesh_mat, error)
+		&& attach(h, *file, section::mesh_color, geo.mesh_color, error)
+		&& attach(h, *file, section::mesh_p1, geo.mesh_p1, error)
+		&& attach(h, *file, section::mesh_p2, geo.mesh_p2, error)
+		&& attach(h, *file, section::mesh_p3, geo.mesh_p3, error)
+		&& attach(h, *file, section::mesh_e1, geo.mesh_e1, error)
+		&& attach(h, *file, section::mesh_e2, geo.mesh_e2, error)
+		&& attach(h, *file, section::mesh_normal, geo.mesh_normal, error)
+		&& attach(h, *file, section::mesh_bvh_sizes, mesh_sizes, error)
+		&& attach(h, *file, section::mesh_bvh_nodes, mesh_nodes, error)
+		&& attach(h, *file, section::mesh_bvh_indices, mesh_indices, error)
+		&& attach(h, *file, section::inst_mesh, geo.inst_mesh, error)
+		&& attach(h, *file, section::inst_transform, geo.inst_transform, error)
+		&& attach(h, *file, section::inst_inverse, geo.inst_inverse, error)
+		&& attach(h, *file, section::inst_object, geo.inst_object, error)
+		&& attach(h, *file, section::bvh_wide, rt.accel.wide_nodes, error)
+		&& attach(h, *file, section::mesh_bvh_wide_sizes, mesh_wide_sizes, error)
+		&& attach(h, *file, section::mesh_bvh_wide, mesh_wide, error)};
+
+	size_t objects{geo.kind.size()};
+	size_t tris{geo.tri_p1.size()};
+	ok = ok && geo.index.size() == objects && geo.mat.size() == objects && geo.color.size() == objects && geo.visible.size() == objects
+		&& geo.sphere_radius.size() == geo.sphere_center.size() && geo.sphere_object.size() == geo.sphere_center.size()
+		&& geo.tri_p2.size() == tris && geo.tri_p3.size() == tris && geo.tri_plane.size() == tris && geo.tri_object.size() == tris
+		&& geo.tri_e1.size() == tris && geo.tri_e2.size() == tris && geo.tri_normal.size() == tris
+		&& geo.sphere_center.size() + tris + geo.inst_mesh.size() == objects;
+
+	// every mesh range and bottom level bvh has to lie inside the stored arrays
+	size_t meshes{geo.mesh_first.size()};
+	ok = ok && geo.mesh_count.size() == meshes && geo.mesh_mat.size() == meshes && geo.mesh_color.size() == meshes
+		&& mesh_sizes.size() == meshes && mesh_wide_sizes.size() == meshes && geo.mesh_p2.size() == geo.mesh_p1.size() && geo.mesh_p3.size() == geo.mesh_p1.size()
+		&& geo.mesh_e1.size() == geo.mesh_p1.size() && geo.mesh_e2.size() == geo.mesh_p1.size() && geo.mesh_normal.size() == geo.mesh_p1.size()
+		&& geo.inst_transform.size() == geo.inst_mesh.size() && geo.inst_inverse.size() == geo.inst_mesh.size() && geo.inst_object.size() == geo.inst_mesh.size();
+	size_t node{};
+	size_t index{};
+	size_t wide{};
+	for (size_t m{}; ok && m < meshes; m++)
+	{
+		size_t first{(size_t)geo.mesh_first[m]};
+		size_t count{(size_t)geo.mesh_count[m]};
+		size_t nodes{mesh_sizes[m]};
+		size_t wide_nodes{mesh_wide_sizes[m]};
+		ok = first <= geo.mesh_p1.size() && count <= geo.mesh_p1.size() - first
+			&& nodes <= mesh_nodes.size() - node && count <= mesh_indices.size() - index
+			&& wide_nodes <= mesh_wide.size() - wide && (nodes > 0) == (count > 0);
+		if (ok)
+		{
+			geo.mesh_bvh.emplace_back();
+			geo.mesh_bvh.back().nodes.attach(mesh_nodes.data() + node, nodes);
+			geo.mesh_bvh.back().indices.attach(mesh_indices.data() + (nodes > 0 ? index : 0), nodes > 0 ? count : 0);
+			geo.mesh_bvh.back().wide_nodes.attach(mesh_wide.data() + wide, wide_nodes);
+			node += nodes;
+			index += nodes > 0 ? count : 0;
+			wide += wide_nodes;
+			ok = valid_tree(geo.mesh_bvh.back(), count);
+		}
+	}
+	for (int m : geo.inst_mesh)
+	{
+		ok = ok && m >= 0 && m < meshes;
+	}
+
+	// the values inside the arrays index other arrays, a damaged file must fail here instead of in the traversal
+	if (ok && !valid_objects(geo))
+	{
+		error = "snapshot objects point outside their shape arrays";
+		ok = false;
+	}
+	for (int obj : rt.unbounded)
+	{
+		ok = ok && obj >= 0 && obj < objects;
+	}
+	if (ok && !valid_tree(rt.accel, objects))
+	{
+		error = "snapshot bvh is damaged";
+		ok = false;
+	}
+	if (!ok)
+	{
+		if (error.empty())
+		{
+			error = "snapshot arrays do not match the object table";
+		}
+		geo.clear();
+		rt.materials.clear();
+		rt.accel.clear();
+		rt.unbounded.clear();
+		return false;
+	}
+
+	camera cam{h.cam};
+	cam.nx = rt.cam.nx;
+	cam.ny = rt.cam.ny;
+	rt.cam = cam;
+	rt.ambient_lights.assign(ambient.begin(), ambient.end());
+	rt.point_lights.assign(lights.begin(), lights.end());
+
+	geo.dirty = false;
+	rt.accel_valid = h.has_bvh != 0;
+	rt.snapshot = file;
+	return true;
+}
+
+#endif
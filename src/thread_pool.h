@@ -0,0 +1,192 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <string>
+
+#include "trace.h"
+
+// persistent workers with one task deque each, idle workers steal from the others
+struct thread_pool
+{
+	struct worker_queue
+	{
+		std::mutex m{};
+		std::deque<int> tasks{};
+	};
+
+	std::vector<std::thread> threads{};
+	std::vector<std::unique_ptr<worker_queue>> queues{};
+	std::function<void(int, int)> job{};
+
+	std::mutex m{};
+	std::condition_variable wake{};
+	std::condition_variable done{};
+	std::atomic<int> remaining{};
+	unsigned long long generation{};
+	bool stopping{false};
+	int requested{-1};
+
+	// index of the pool thread running the calling code, 0 on the thread calling run
+	static inline thread_local int current{};
+
+	thread_pool()
+	{
+	}
+
+	thread_pool(int count)
+	{
+		start(count);
+	}
+
+	// count includes the calling thread, 0 uses every hardware thread
+	void start(int count)
+	{
+		stop();
+		requested = count;
+		if (count <= 0)
+		{
+			count = std::max(1u, std::thread::hardware_concurrency());
+		}
+		queues.clear();
+		for (int i{}; i < count; i++)
+		{
+			queues.push_back(std::make_unique<worker_queue>());
+		}
+		stopping = false;
+		for (int i{1}; i < count; i++)
+		{
+			threads.emplace_back([this, i] { worker(i); });
+		}
+	}
+
+	int size() const
+	{
+		return queues.size();
+	}
+
+	// runs fn(task, thread) for every task in [0, count) and returns once all have finished
+	void run(int count, std::function<void(int, int)> fn)
+	{
+		if (count <= 0)
+		{
+			return;
+		}
+		if (queues.empty())
+		{
+			start(0);
+		}
+		{
+			std::lock_guard<std::mutex> lock{m};
+			job = std::move(fn);
+			remaining = count;
+			// contiguous blocks keep neighbouring tiles on the same worker until it has to steal
+			int n{size()};
+			for (int q{}; q < n; q++)
+			{
+				std::lock_guard<std::mutex> ql{queues[q]->m};
+				for (int t{count * q / n}; t < count * (q + 1) / n; t++)
+				{
+					queues[q]->tasks.push_back(t);
+				}
+			}
+			generation++;
+		}
+		wake.notify_all();
+
+		drain(0);
+
+		std::unique_lock<std::mutex> lock{m};
+		done.wait(lock, [this] { return remaining == 0; });
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock{m};
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+		threads.clear();
+	}
+
+	~thread_pool()
+	{
+		stop();
+	}
+
+private:
+	bool pop(int self, int& task)
+	{
+		worker_queue& own{*queues[self]};
+		{
+			std::lock_guard<std::mutex> lock{own.m};
+			if (!own.tasks.empty())
+			{
+				task = own.tasks.back();
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for (int i{1}; i < size(); i++)
+		{
+			worker_queue& victim{*queues[(self + i) % size()]};
+			std::lock_guard<std::mutex> lock{victim.m};
+			if (!victim.tasks.empty())
+			{
+				task = victim.tasks.front();
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void drain(int self)
+	{
+		int task{};
+		while (pop(self, task))
+		{
+			job(task, self);
+			if (--remaining == 0)
+			{
+				std::lock_guard<std::mutex> lock{m};
+				done.notify_all();
+			}
+		}
+	}
+
+	void worker(int self)
+	{
+		current = self;
+		tracer::get().name_thread("pool " + std::to_string(self));
+		unsigned long long seen{};
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock{m};
+				wake.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping)
+				{
+					return;
+				}
+				seen = generation;
+			}
+			drain(self);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+
+// timed events of the next few frames, written as chrome trace json for chrome://tracing or ui.perfetto.dev
+struct trace_event
+{
+	const char* name{};
+	long long start{}; // nanoseconds since the capture started
+	long long duration{};
+	int thread{};
+	int tile{-1};
+	// numeric arguments shown with the event, the names are string literals
+	const char* arg_names[3]{};
+	double args[3]{};
+};
+
+// collects the events of every thread until the requested number of frames is done, then writes them.
+// while no capture runs a scoped event only reads the on flag
+struct tracer
+{
+	static inline std::atomic<bool> on{false};
+
+	std::mutex m{};
+	std::vector<trace_event> events{};
+	std::vector<std::string> thread_names{};
+	// read by scopes of every thread without the lock while start may set them, hence atomic
+	std::atomic<long long> origin{}; // steady clock nanoseconds the capture started at
+	int frames_left{};
+	std::string path{};
+	std::atomic<bool> written{false};
+
+	static tracer& get()
+	{
+		static tracer t{};
+		return t;
+	}
+
+	static long long now()
+	{
+		return clock_ns() - get().origin.load(std::memory_order_relaxed);
+	}
+
+	static long long clock_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// small ids in the order the threads first show up, so the timeline lists them in a stable order
+	int thread_id()
+	{
+		static thread_local int id{-1};
+		if (id < 0)
+		{
+			std::lock_guard<std::mutex> lock{m};
+			id = thread_names.size();
+			thread_names.push_back("thread " + std::to_string(id));
+		}
+		return id;
+	}
+
+	void name_thread(const std::string& name)
+	{
+		int id{thread_id()};
+		std::lock_guard<std::mutex> lock{m};
+		thread_names[id] = name;
+	}
+
+	// records the next frames and writes them to file once the last one is done
+	void start(int frames, const std::string& file)
+	{
+		std::lock_guard<std::mutex> lock{m};
+		events.clear();
+		origin = clock_ns();
+		frames_left = frames;
+		path = file;
+		written = false;
+		on = frames > 0;
+	}
+
+	void add(const trace_event& e)
+	{
+		std::lock_guard<std::mutex> lock{m};
+		events.push_back(e);
+	}
+
+	void frame_done()
+	{
+		if (!on)
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> lock{m};
+		if (--frames_left == 0)
+		{
+			on = false;
+			written = write();
+		}
+	}
+
+private:
+	bool write() const
+	{
+		FILE* f{std::fopen(path.c_str(), "w")};
+		if (!f)
+		{
+			return false;
+		}
+		std::fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		for (size_t t{}; t < thread_names.size(); t++)
+		{
+			std::fprintf(f, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"%s\"}},\n", t, thread_names[t].c_str());
+		}
+		for (size_t i{}; i < events.size(); i++)
+		{
+			const trace_event& e{events[i]};
+			std::fprintf(f, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+				e.name, e.thread, e.start / 1e3, e.duration / 1e3);
+			const char* separator{""};
+			if (e.tile >= 0)
+			{
+				std::fprintf(f, "\"tile\": %d", e.tile);
+				separator = ", ";
+			}
+			for (int a{}; a < 3 && e.arg_names[a]; a++)
+			{
+				std::fprintf(f, "%s\"%s\": %g", separator, e.arg_names[a], e.args[a]);
+				separator = ", ";
+			}
+			std::fprintf(f, "}}%s\n", i + 1 < events.size() ? "," : "");
+		}
+		std::fprintf(f, "]}\n");
+		return std::fclose(f) == 0;
+	}
+};
+
+// records the time until it goes out of scope as an event of the calling thread while a capture runs
+struct trace_scope
+{
+	trace_event e{};
+	bool active{false};
+
+	trace_scope(const char* name, int tile=-1)
+	{
+		if (!tracer::on.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+		active = true;
+		e.name = name;
+		e.tile = tile;
+		e.thread = tracer::get().thread_id();
+		e.start = tracer::now();
+	}
+
+	trace_scope(const trace_scope&) = delete;
+	trace_scope& operator=(const trace_scope&) = delete;
+
+	void arg(const char* name, double value)
+	{
+		for (int a{}; active && a < 3; a++)
+		{
+			if (!e.arg_names[a])
+			{
+				e.arg_names[a] = name;
+				e.args[a] = value;
+				return;
+			}
+		}
+	}
+
+	~trace_scope()
+	{
+		if (active)
+		{
+			e.duration = tracer::now() - e.start;
+			tracer::get().add(e);
+		}
+	}
+};
+
+// splits the time of an active scope into three phases, mark(p) adds the time since the previous mark to phase p.
+// the sums in microseconds become arguments of the scope, without a capture nothing is timed
+struct trace_phases
+{
+	trace_scope* scope{};
+	const char* names[3]{};
+	long long sums[3]{};
+	long long last{};
+	bool timed{false};
+
+	trace_phases(trace_scope* s, const char* a, const char* b, const char* c)
+		: scope{s}
+		, names{a, b, c}
+		, timed{s && s->active}
+	{
+		if (timed)
+		{
+			last = tracer::now();
+		}
+	}
+
+	trace_phases(const trace_phases&) = delete;
+	trace_phases& operator=(const trace_phases&) = delete;
+
+	void mark(int phase)
+	{
+		if (timed)
+		{
+			long long t{tracer::now()};
+			sums[phase] += t - last;
+			last = t;
+		}
+	}
+
+	~trace_phases()
+	{
+		for (int p{}; timed && p < 3; p++)
+		{
+			scope->arg(names[p], sums[p] / 1e3);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,394 @@
+// renders the reference scenes in every render mode and compares them with the golden images in scenes/golden,
+// then edits scenes between renders so reshading, relighting, region updates and progressive passes are compared
+// with a fresh render of the edited scene. a case fails below its psnr or above its largest channel error and
+// leaves its render and a diff image behind
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <filesystem>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "raytracer.h"
+#include "render_thread.h"
+#include "scene_io.h"
+#include "test_scenes.h"
+
+struct options
+{
+	int res{256};
+	bool update{false};
+	std::string only{};
+	std::string golden{"scenes/golden"};
+	std::string out{"golden_out"};
+};
+
+struct golden_case
+{
+	std::string name{};
+	std::function<bool(ray_tracer&)> build{};
+	int bounces{1};
+	bool blinn_phong{false};
+	bool linear{true}; // also compare the linear scan, too slow for large scenes
+	float min_psnr{45.0f};
+	int max_error{16};
+};
+
+// renders the scene, edits it and renders again the way the interactive renderer would. path tells whether the
+// second render takes the incremental path the case is about, progressive renders both frames in refining passes
+struct edit_case
+{
+	std::string name{};
+	std::function<bool(ray_tracer&)> build{};
+	std::function<void(ray_tracer&)> edit{};
+	std::function<bool(const ray_tracer&)> path{};
+	int bounces{1};
+	bool relight_layers{false};
+	bool progressive{false};
+	float min_psnr{45.0f};
+	int max_error{16};
+};
+
+// the settings every case is rendered with, all of them have to match the same golden image
+struct render_mode
+{
+	const char* name{};
+	bool packets{true};
+	bool wavefront{false};
+	bool wide{true};
+	bool bvh{true};
+};
+
+static void usage()
+{
+	std::printf(
+		"usage: golden [options]\n"
+		"  --res N           render resolution of every case (default 256)\n"
+		"  --scene NAME      only run the named case\n"
+		"  --golden DIR      golden images (default scenes/golden)\n"
+		"  --out DIR         renders and diff images of failed cases, created on the first failure (default golden_out)\n"
+		"  --update          replace the golden images with the current renders\n");
+}
+
+static bool parse(int argc, char** argv, options& o)
+{
+	for (int i{1}; i < argc; i++)
+	{
+		std::string arg{argv[i]};
+		bool has_value{i + 1 < argc};
+		if (arg == "--res" && has_value)
+		{
+			o.res = std::atoi(argv[++i]);
+		}
+		else if (arg == "--scene" && has_value)
+		{
+			o.only = argv[++i];
+		}
+		else if (arg == "--golden" && has_value)
+		{
+			o.golden = argv[++i];
+		}
+		else if (arg == "--out" && has_value)
+		{
+			o.out = argv[++i];
+		}
+		else if (arg == "--update")
+		{
+			o.update = true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return o.res > 0;
+}
+
+static std::function<bool(ray_tracer&)> procedural(void (*build)(ray_tracer&))
+{
+	return [build](ray_tracer& rt)
+	{
+		build(rt);
+		return true;
+	};
+}
+
+static std::function<bool(ray_tracer&)> file(const std::string& path)
+{
+	return [path](ray_tracer& rt)
+	{
+		scene_load_stats stats{};
+		if (!load_scene(rt, path, stats))
+		{
+			std::fprintf(stderr, "%s: %s\n", path.c_str(), stats.error.c_str());
+			return false;
+		}
+		return true;
+	};
+}
+
+struct comparison
+{
+	double psnr{};
+	int max_error{};
+};
+
+static comparison compare(const unsigned char* a, const unsigned char* b, size_t bytes)
+{
+	comparison c{};
+	double squared{};
+	for (size_t i{}; i < bytes; i++)
+	{
+		int d{std::abs(a[i] - b[i])};
+		c.max_error = std::max(c.max_error, d);
+		squared += d * d;
+	}
+	double mse{squared / bytes};
+	c.psnr = mse == 0.0 ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / mse);
+	return c;
+}
+
+// the difference scaled by 16 so errors of a few steps stand out
+static bool write_diff(const std::string& path, const unsigned char* a, const unsigned char* b, int width, int height)
+{
+	std::vector<unsigned char> diff((size_t)width * height * 3);
+	for (size_t i{}; i < diff.size(); i++)
+	{
+		diff[i] = std::min(255, std::abs(a[i] - b[i]) * 16);
+	}
+	stbi_flip_vertically_on_write(true);
+	return stbi_write_png(path.c_str(), width, height, 3, diff.data(), width * 3) != 0;
+}
+
+// prints how close the render is to its reference, a failed one leaves the render and a diff image in out
+static bool check(const options& o, const std::string& name, const char* mode, ray_tracer& rt, const unsigned char* reference, float min_psnr, int max_error)
+{
+	comparison result{compare(rt.image, reference, (size_t)rt.width * rt.height * 3)};
+	bool pass{result.psnr >= min_psnr && result.max_error <= max_error};
+	std::printf("%-14s %-10s psnr %7.2f dB  max error %3d  %s\n", name.c_str(), mode, result.psnr, result.max_error, pass ? "ok" : "FAILED");
+	if (!pass)
+	{
+		std::filesystem::create_directories(o.out);
+		std::string base{o.out + "/" + name + "_" + mode};
+		rt.write_image(base + ".png");
+		write_diff(base + "_diff.png", rt.image, reference, rt.width, rt.height);
+	}
+	return pass;
+}
+
+// moves an object through the same delta the render thread applies, which keeps the bounds it had in the last image
+static void move_object(ray_tracer& rt, int obj, glm::vec3 offset)
+{
+	std::vector<object_move> moves{};
+	std::vector<int> earlier{std::exchange(rt.geo.moved, {obj})};
+	record_moves(rt.geo, moves);
+	rt.geo.moved = earlier;
+	for (glm::vec3& p : moves[0].p)
+	{
+		p += offset;
+	}
+	moves[0].transform[3] += glm::vec4{offset, 0.0f};
+	apply_moves(rt, moves, false);
+}
+
+static int first_of(const ray_tracer& rt, shape kind)
+{
+	for (int obj{}; obj < rt.geo.size(); obj++)
+	{
+		if (rt.geo.kind[obj] == kind)
+		{
+			return obj;
+		}
+	}
+	return -1;
+}
+
+static void render_frame(ray_tracer& rt, bool progressive)
+{
+	if (!progressive)
+	{
+		rt.render();
+		return;
+	}
+	for (int step{8}; step >= 1; step /= 2)
+	{
+		rt.render(step, step < 8);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	options o{};
+	if (!parse(argc, argv, o))
+	{
+		usage();
+		return 1;
+	}
+
+	std::vector<golden_case> cases{
+		{"default", procedural(builtin)},
+		{"default_blinn", procedural(builtin), 1, true},
+		{"instances", file("scenes/instances.scene")},
+		{"spheres", procedural(sphere_field)},
+		{"triangle_soup", [](ray_tracer& rt) { triangle_soup(rt, 20000); return true; }, 1, false, false},
+		{"many_lights", procedural(many_lights)},
+		{"mirrors", procedural(mirror_hall), 8},
+	};
+	std::vector<render_mode> modes{
+		{"packets"},
+		{"rays", false},
+		{"wavefront", true, true},
+		{"binary", true, false, false},
+		{"linear", false, false, true, false},
+	};
+
+	std::vector<edit_case> edits{
+		{"reshade", procedural(builtin), [](ray_tracer& rt)
+			{
+				rt.materials[0].k_d = 0.8f;
+				rt.geo.color[0] = glm::vec3{0.2f, 0.6f, 1.0f};
+				rt.point_lights[0].color = glm::vec3{1.0f, 0.8f, 0.6f};
+				rt.shading_version++;
+			},
+			[](const ray_tracer& rt) { return rt.cached(); }},
+		{"relight", procedural(many_lights), [](ray_tracer& rt)
+			{
+				rt.point_lights[3].p += glm::vec3{0.5f, -1.0f, 0.5f};
+				rt.point_lights[7].color = glm::vec3{0.2f, 0.0f, 0.1f};
+			},
+			[](const ray_tracer& rt) { return rt.cached(); }, 1, true},
+		{"region", procedural(sphere_field), [](ray_tracer& rt)
+			{
+				move_object(rt, 300, glm::vec3{0.2f, 0.3f, 0.0f});
+				move_object(rt, 700, glm::vec3{-0.4f, 0.0f, 0.3f});
+			},
+			[](const ray_tracer& rt) { return rt.patchable(); }},
+		{"region_mirror", procedural(mirror_hall), [](ray_tracer& rt)
+			{
+				move_object(rt, first_of(rt, shape::sphere), glm::vec3{0.5f, 0.5f, 0.0f});
+			},
+			[](const ray_tracer& rt) { return rt.patchable(); }, 8},
+		{"region_mesh", file("scenes/instances.scene"), [](ray_tracer& rt)
+			{
+				move_object(rt, first_of(rt, shape::instance), glm::vec3{0.0f, 0.5f, 0.3f});
+			},
+			[](const ray_tracer& rt) { return rt.patchable(); }},
+		{"progressive", procedural(mirror_hall), [](ray_tracer& rt)
+			{
+				look(rt, glm::vec3{-2.0f, 3.5f, -11.0f}, glm::vec3{1.0f, 1.5f, 0.0f});
+			},
+			nullptr, 4, false, true},
+	};
+
+	if (o.update)
+	{
+		std::filesystem::create_directories(o.golden);
+	}
+	int failed{};
+	int run{};
+	for (const golden_case& c : cases)
+	{
+		if (!o.only.empty() && c.name != o.only)
+		{
+			continue;
+		}
+		ray_tracer rt{};
+		if (!c.build(rt))
+		{
+			failed++;
+			continue;
+		}
+		rt.bounce_count = c.bounces;
+		rt.blinn_phong = c.blinn_phong;
+		rt.shading_cache = false;
+		rt.resize(o.res, o.res);
+
+		std::string golden_path{o.golden + "/" + c.name + ".png"};
+		std::vector<unsigned char> golden{};
+		for (const render_mode& m : modes)
+		{
+			if (!m.bvh && !c.linear)
+			{
+				continue;
+			}
+			rt.packets = m.packets;
+			rt.wavefront = m.wavefront;
+			rt.wide_bvh = m.wide;
+			rt.use_bvh = m.bvh;
+			rt.render();
+			size_t bytes{(size_t)rt.width * rt.height * 3};
+			run++;
+
+			if (o.update && golden.empty())
+			{
+				if (!rt.write_image(golden_path))
+				{
+					std::fprintf(stderr, "failed to write %s\n", golden_path.c_str());
+					return 1;
+				}
+				std::printf("%-14s wrote %s\n", c.name.c_str(), golden_path.c_str());
+			}
+			if (golden.empty())
+			{
+				int width{};
+				int height{};
+				int channels{};
+				stbi_set_flip_vertically_on_load(true);
+				unsigned char* data{stbi_load(golden_path.c_str(), &width, &height, &channels, 3)};
+				if (!data || width != rt.width || height != rt.height)
+				{
+					std::printf("%-14s %-10s missing or %dx%d golden image %s, run with --update\n", c.name.c_str(), m.name, width, height, golden_path.c_str());
+					stbi_image_free(data);
+					failed++;
+					break;
+				}
+				golden.assign(data, data + bytes);
+				stbi_image_free(data);
+			}
+
+			failed += !check(o, c.name, m.name, rt, golden.data(), c.min_psnr, c.max_error);
+		}
+	}
+
+	// the reference is a fresh render of the edited scene without the shading cache
+	for (const edit_case& c : edits)
+	{
+		if (!o.only.empty() && c.name != o.only)
+		{
+			continue;
+		}
+		ray_tracer rt{};
+		ray_tracer fresh{};
+		if (!c.build(rt) || !c.build(fresh))
+		{
+			failed++;
+			continue;
+		}
+		rt.bounce_count = fresh.bounce_count = c.bounces;
+		rt.relight_layers = c.relight_layers;
+		fresh.shading_cache = false;
+		rt.resize(o.res, o.res);
+		fresh.resize(o.res, o.res);
+
+		render_frame(rt, c.progressive);
+		c.edit(rt);
+		c.edit(fresh);
+		run++;
+		if (c.path && !c.path(rt))
+		{
+			std::printf("%-14s %-10s the edit does not take the incremental path\n", c.name.c_str(), "edit");
+			failed++;
+			continue;
+		}
+		render_frame(rt, c.progressive);
+		fresh.render();
+		failed += !check(o, c.name, "edit", rt, fresh.image, c.min_psnr, c.max_error);
+	}
+	std::printf("%d of %d renders failed\n", failed, run);
+	return failed == 0 ? 0 : 1;
+}
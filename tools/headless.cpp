@@ -0,0 +1,227 @@
+// renders a scene to a file without a window, opengl or imgui
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <iterator>
+
+#include "raytracer.h"
+#include "scene_io.h"
+
+struct options
+{
+	int width{1024};
+	int height{1024};
+	int threads{0};
+	int tile{16};
+	int bounces{1};
+	float min_throughput{1.0f / 256};
+	bool bvh{true};
+	bool wide{true};
+	bool packets{true};
+	bool wavefront{false};
+	bool stats{false};
+	heatmap_view heatmap{heatmap_view::off};
+	std::string trace{};
+	std::string scene{"default"};
+	std::string out{"render.png"};
+};
+
+static void usage()
+{
+	std::printf(
+		"usage: headless [options]\n"
+		"  --res N | WxH     output resolution (default 1024)\n"
+		"  --threads N       render threads, 0 uses every core (default 0)\n"
+		"  --tile N          tile size in pixels (default 16)\n"
+		"  --bounces N       reflection bounce count (default 1)\n"
+		"  --min-throughput X  stop reflecting once a path carries less than X (default 1/256)\n"
+		"  --scene PATH      text, binary or snapshot scene file, default is the built-in scene\n"
+		"  --out PATH        output image, .png or .jpg (default render.png)\n"
+		"  --no-bvh          use the linear scan instead of the bvh\n"
+		"  --binary-bvh      traverse the binary bvh nodes instead of the 4-wide ones\n"
+		"  --no-packets      trace every primary and shadow ray on its own\n"
+		"  --wavefront       render in stages of binned primary, shadow and reflection rays\n"
+		"  --heatmap VIEW    color pixels by their tests, steps or rays instead of shading them\n"
+		"  --trace PATH      write the events of the render as chrome trace json\n"
+		"  --stats           time the hot functions and print the rays and intersection tests of the render\n");
+}
+
+static bool parse(int argc, char** argv, options& o)
+{
+	for (int i{1}; i < argc; i++)
+	{
+		std::string arg{argv[i]};
+		bool has_value{i + 1 < argc};
+		if (arg == "--res" && has_value)
+		{
+			int read{std::sscanf(argv[++i], "%dx%d", &o.width, &o.height)};
+			if (read < 1)
+			{
+				return false;
+			}
+			if (read == 1)
+			{
+				o.height = o.width;
+			}
+		}
+		else if (arg == "--threads" && has_value)
+		{
+			o.threads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--tile" && has_value)
+		{
+			o.tile = std::atoi(argv[++i]);
+		}
+		else if (arg == "--bounces" && has_value)
+		{
+			o.bounces = std::atoi(argv[++i]);
+		}
+		else if (arg == "--min-throughput" && has_value)
+		{
+			o.min_throughput = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (arg == "--scene" && has_value)
+		{
+			o.scene = argv[++i];
+		}
+		else if (arg == "--out" && has_value)
+		{
+			o.out = argv[++i];
+		}
+		else if (arg == "--no-bvh")
+		{
+			o.bvh = false;
+		}
+		else if (arg == "--binary-bvh")
+		{
+			o.wide = false;
+		}
+		else if (arg == "--no-packets")
+		{
+			o.packets = false;
+		}
+		else if (arg == "--wavefront")
+		{
+			o.wavefront = true;
+		}
+		else if (arg == "--heatmap" && has_value)
+		{
+			std::string view{argv[++i]};
+			auto name{std::find(std::begin(heatmap_names), std::end(heatmap_names), view)};
+			if (name == std::end(heatmap_names))
+			{
+				return false;
+			}
+			o.heatmap = static_cast<heatmap_view>(name - std::begin(heatmap_names));
+		}
+		else if (arg == "--trace" && has_value)
+		{
+			o.trace = argv[++i];
+		}
+		else if (arg == "--stats")
+		{
+			o.stats = true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return o.width > 0 && o.height > 0;
+}
+
+int main(int argc, char** argv)
+{
+	options o{};
+	if (!parse(argc, argv, o))
+	{
+		usage();
+		return 1;
+	}
+
+	using clock = std::chrono::steady_clock;
+	auto start{clock::now()};
+
+	ray_tracer rt{};
+	scene_load_stats stats{};
+	bool loaded{o.scene == "default"
+		? load_scene_text(rt, default_scene_text, stats)
+		: load_scene(rt, o.scene, stats)};
+	if (!loaded)
+	{
+		std::fprintf(stderr, "%s: %s\n", o.scene.c_str(), stats.error.c_str());
+		return 1;
+	}
+	rt.thread_count = o.threads;
+	rt.tile_size = o.tile;
+	rt.bounce_count = o.bounces;
+	rt.min_throughput = o.min_throughput;
+	rt.use_bvh = o.bvh;
+	rt.wide_bvh = o.wide;
+	rt.packets = o.packets;
+	rt.wavefront = o.wavefront;
+	rt.timers = o.stats;
+	rt.heatmap = o.heatmap;
+	rt.shading_cache = false; // a single frame never reshades
+	rt.resize(o.width, o.height);
+	rt.fit_view();
+	rt.pool.start(rt.thread_count);
+
+	// the render and the encoding of the image are the two frames of the capture
+	if (!o.trace.empty())
+	{
+		tracer::get().name_thread("main");
+		tracer::get().start(2, o.trace);
+	}
+	auto render_start{clock::now()};
+	rt.render();
+	auto render_end{clock::now()};
+
+	if (!rt.write_image(o.out))
+	{
+		std::fprintf(stderr, "failed to write %s\n", o.out.c_str());
+		return 1;
+	}
+	tracer::get().frame_done();
+	if (!o.trace.empty() && !tracer::get().written)
+	{
+		std::fprintf(stderr, "failed to write %s\n", o.trace.c_str());
+	}
+	auto end{clock::now()};
+
+	auto ms{[](clock::time_point a, clock::time_point b)
+	{
+		return std::chrono::duration<double, std::milli>(b - a).count();
+	}};
+	double render_ms{ms(render_start, render_end)};
+	std::printf("%s: %dx%d, %d threads, %d objects\n", o.out.c_str(), rt.width, rt.height, rt.pool.size(), rt.geo.size());
+	std::printf("load   %9.2f ms  (%s, %zu bytes, %d objects, %d lights)\n", stats.ms, stats.mapped ? "snapshot" : stats.binary ? "binary" : "text", stats.bytes, stats.objects, stats.lights);
+	std::printf("setup  %9.2f ms\n", ms(start, render_start));
+	if (rt.use_bvh && rt.accel.build_ms == 0.0 && !rt.accel.empty())
+	{
+		std::printf("bvh    loaded with the scene (%zu primitives, %zu nodes)\n", rt.accel.indices.size(), rt.accel.nodes.size());
+	}
+	else if (rt.use_bvh)
+	{
+		std::printf("bvh    %9.2f ms  (%zu primitives, %zu nodes, sah cost %.2f)\n", rt.accel.build_ms, rt.accel.indices.size(), rt.accel.nodes.size(), rt.accel.cost());
+	}
+	std::printf("render %9.2f ms  (%.2f Mprimary rays/s)\n", render_ms, (double)rt.width * rt.height / render_ms / 1e3);
+	std::printf("write  %9.2f ms\n", ms(render_end, end));
+	std::printf("total  %9.2f ms\n", ms(start, end));
+	std::printf("time to first pixel %9.2f ms\n", ms(start, rt.first_tile));
+	if (rt.heatmap != heatmap_view::off)
+	{
+		std::printf("heatmap red is %u %s per pixel\n", rt.heatmap_max, heatmap_names[static_cast<int>(rt.heatmap)]);
+	}
+	if (o.stats)
+	{
+		// the times are summed over the threads, the shader includes the reflection hits and shadow rays it traces
+		render_counts c{rt.counters.total()};
+		std::printf("rays   primary %llu, shadow %llu, reflection %llu  (%.2f Mrays/s)\n", c.primary, c.shadow, c.reflection, c.rays() / render_ms / 1e3);
+		std::printf("tests  sphere %llu, triangle %llu, instance %llu\n", c.sphere_tests, c.triangle_tests, c.instance_tests);
+		std::printf("time   calculate_hit %.2f ms, shader %.2f ms, shadow rays %.2f ms  (over %d threads)\n", c.hit_ns / 1e6, c.shader_ns / 1e6, c.shadow_ns / 1e6, rt.pool.size());
+	}
+}
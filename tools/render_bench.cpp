@@ -0,0 +1,229 @@
+// renders a fixed set of scenes without a window and reports timings, ray counts and memory as json
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "raytracer.h"
+#include "scene_io.h"
+#include "test_scenes.h"
+
+struct options
+{
+	int width{512};
+	int height{512};
+	int threads{0};
+	int repeat{3};
+	std::string only{};
+	std::string out{};
+};
+
+struct bench_scene
+{
+	std::string name{};
+	std::vector<int> bounces{};
+	std::function<void(ray_tracer&)> build{};
+};
+
+static void usage()
+{
+	std::printf(
+		"usage: render_bench [options]\n"
+		"  --res N | WxH     render resolution (default 512)\n"
+		"  --threads N       render threads, 0 uses every core (default 0)\n"
+		"  --repeat N        renders per scene, the fastest and the median are reported (default 3)\n"
+		"  --scene NAME      only run the named scene\n"
+		"  --out PATH        write the json to PATH instead of stdout\n");
+}
+
+static bool parse(int argc, char** argv, options& o)
+{
+	for (int i{1}; i < argc; i++)
+	{
+		std::string arg{argv[i]};
+		bool has_value{i + 1 < argc};
+		if (arg == "--res" && has_value)
+		{
+			int read{std::sscanf(argv[++i], "%dx%d", &o.width, &o.height)};
+			if (read < 1)
+			{
+				return false;
+			}
+			if (read == 1)
+			{
+				o.height = o.width;
+			}
+		}
+		else if (arg == "--threads" && has_value)
+		{
+			o.threads = std::atoi(argv[++i]);
+		}
+		else if (arg == "--repeat" && has_value)
+		{
+			o.repeat = std::atoi(argv[++i]);
+		}
+		else if (arg == "--scene" && has_value)
+		{
+			o.only = argv[++i];
+		}
+		else if (arg == "--out" && has_value)
+		{
+			o.out = argv[++i];
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return o.width > 0 && o.height > 0 && o.repeat > 0;
+}
+
+// bytes of the process that are resident, 0 where it can not be read
+static size_t resident_bytes()
+{
+#ifdef __linux__
+	size_t pages{};
+	size_t resident{};
+	if (FILE* f{std::fopen("/proc/self/statm", "r")})
+	{
+		if (std::fscanf(f, "%zu %zu", &pages, &resident) != 2)
+		{
+			resident = 0;
+		}
+		std::fclose(f);
+	}
+	return resident * sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+// bytes allocated on the heap and not freed yet, 0 where the allocator can not tell
+static size_t heap_bytes()
+{
+#ifdef __GLIBC__
+	struct mallinfo2 info{mallinfo2()};
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+int main(int argc, char** argv)
+{
+	options o{};
+	if (!parse(argc, argv, o))
+	{
+		usage();
+		return 1;
+	}
+
+	std::vector<bench_scene> scenes{
+		{"default", {1}, builtin},
+		{"spheres", {1}, sphere_field},
+		{"triangle_soup", {1}, [](ray_tracer& rt) { triangle_soup(rt, 200000); }},
+		{"many_lights", {1}, many_lights},
+		{"mirrors", {1, 4, 16}, mirror_hall},
+	};
+
+	using clock = std::chrono::steady_clock;
+	auto ms{[](clock::time_point a, clock::time_point b)
+	{
+		return std::chrono::duration<double, std::milli>(b - a).count();
+	}};
+
+	std::string json{};
+	char line[512];
+	int runs{};
+	std::snprintf(line, sizeof(line), "{\n  \"width\": %d,\n  \"height\": %d,\n  \"repeat\": %d,\n  \"runs\": [", o.width, o.height, o.repeat);
+	json += line;
+	for (const bench_scene& s : scenes)
+	{
+		if (!o.only.empty() && s.name != o.only)
+		{
+			continue;
+		}
+		for (int bounces : s.bounces)
+		{
+			size_t heap_before{heap_bytes()};
+			ray_tracer rt{};
+			rt.thread_count = o.threads;
+			rt.bounce_count = bounces;
+			rt.shading_cache = false; // every repeat traces the whole image
+			rt.progressive = false;
+			rt.resize(o.width, o.height);
+			rt.pool.start(rt.thread_count);
+
+			// setup covers generating the scene, preparing it and building the bvh
+			auto setup_start{clock::now()};
+			s.build(rt);
+			rt.fit_view();
+			rt.commit();
+			auto setup_end{clock::now()};
+
+			std::vector<double> times{};
+			for (int r{}; r < o.repeat; r++)
+			{
+				auto start{clock::now()};
+				rt.render();
+				times.push_back(ms(start, clock::now()));
+			}
+			std::vector<double> sorted{times};
+			std::sort(sorted.begin(), sorted.end());
+			double median{sorted[sorted.size() / 2]};
+			size_t heap_after{heap_bytes()};
+
+			// the counts are the same for every repeat, the rates use the median time
+			render_counts rays{rt.counters.total()};
+			auto rate{[&](unsigned long long count)
+			{
+				return count / median / 1e3;
+			}};
+			std::snprintf(line, sizeof(line),
+				"%s\n    {\"scene\": \"%s\", \"bounces\": %d, \"objects\": %d, \"lights\": %zu, \"threads\": %d,\n"
+				"     \"setup_ms\": %.3f, \"build_ms\": %.3f, \"render_ms\": %.3f, \"render_ms_min\": %.3f,\n",
+				runs++ ? "," : "", s.name.c_str(), bounces, rt.geo.size(), rt.point_lights.size(), rt.pool.size(),
+				ms(setup_start, setup_end), rt.accel.build_ms, median, sorted.front());
+			json += line;
+			std::snprintf(line, sizeof(line),
+				"     \"rays\": {\"primary\": %llu, \"shadow\": %llu, \"reflection\": %llu, \"total\": %llu},\n"
+				"     \"mrays_per_s\": {\"primary\": %.3f, \"shadow\": %.3f, \"reflection\": %.3f, \"total\": %.3f},\n",
+				rays.primary, rays.shadow, rays.reflection, rays.rays(),
+				rate(rays.primary), rate(rays.shadow), rate(rays.reflection), rate(rays.rays()));
+			json += line;
+			std::snprintf(line, sizeof(line),
+				"     \"tests\": {\"sphere\": %llu, \"triangle\": %llu, \"instance\": %llu, \"total\": %llu},\n",
+				rays.sphere_tests, rays.triangle_tests, rays.instance_tests, rays.tests());
+			json += line;
+			// the heap the scene, its bvh, the image and the render buffers hold, and the whole process
+			std::snprintf(line, sizeof(line), "     \"heap_bytes\": %zu, \"resident_bytes\": %zu}",
+				heap_after - std::min(heap_before, heap_after), resident_bytes());
+			json += line;
+			std::fprintf(stderr, "%s bounces %d: %.2f ms\n", s.name.c_str(), bounces, median);
+		}
+	}
+	json += "\n  ]\n}\n";
+
+	if (o.out.empty())
+	{
+		std::fputs(json.c_str(), stdout);
+		return 0;
+	}
+	FILE* f{std::fopen(o.out.c_str(), "w")};
+	if (!f)
+	{
+		std::fprintf(stderr, "failed to write %s\n", o.out.c_str());
+		return 1;
+	}
+	std::fputs(json.c_str(), f);
+	std::fclose(f);
+}
@@ -0,0 +1,50 @@
+// converts between the text and binary scene formats, the output format follows the extension
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "raytracer.h"
+#include "scene_io.h"
+
+static bool ends_with(const std::string& s, const std::string& suffix)
+{
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		std::printf("usage: scene_convert IN OUT\n"
+			"  IN   text or binary scene, or \"default\" for the built-in scene\n"
+			"  OUT  .rtss writes a mappable snapshot, .rtsb the binary format, anything else text\n");
+		return 1;
+	}
+	std::string in{argv[1]};
+	std::string out{argv[2]};
+
+	ray_tracer rt{};
+	scene_load_stats stats{};
+	bool loaded{in == "default"
+		? load_scene_text(rt, default_scene_text, stats)
+		: load_scene(rt, in, stats)};
+	if (!loaded)
+	{
+		std::fprintf(stderr, "%s: %s\n", in.c_str(), stats.error.c_str());
+		return 1;
+	}
+
+	auto start{std::chrono::steady_clock::now()};
+	bool snapshot{ends_with(out, ".rtss")};
+	bool binary{ends_with(out, ".rtsb")};
+	bool written{snapshot ? write_snapshot(rt, out) : binary ? write_scene_binary(rt, out) : write_scene_text(rt, out)};
+	double write_ms{std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()};
+	if (!written)
+	{
+		std::fprintf(stderr, "failed to write %s\n", out.c_str());
+		return 1;
+	}
+	std::printf("%s -> %s: %d objects, %d lights\n", in.c_str(), out.c_str(), stats.objects, stats.lights);
+	std::printf("load  %9.2f ms  (%s, %zu bytes)\n", stats.ms, stats.mapped ? "snapshot" : stats.binary ? "binary" : "text", stats.bytes);
+	std::printf("write %9.2f ms  (%s)\n", write_ms, snapshot ? "snapshot, includes prepare and bvh build" : binary ? "binary" : "text");
+}
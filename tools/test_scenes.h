@@ -0,0 +1,141 @@
+#ifndef TEST_SCENES_H
+#define TEST_SCENES_H
+
+#include <random>
+#include <cmath>
+
+#include "raytracer.h"
+#include "scene_io.h"
+
+// procedural scenes of render_bench and golden, generated from fixed seeds so every run sees the same scene
+
+// uniform floats from mt19937, mapped the same way by every standard library unlike std::uniform_real_distribution.
+// braced initializers evaluate in order, function arguments do not, so draws for one call go through locals
+struct scene_random
+{
+	std::mt19937 rng{1};
+
+	float unit()
+	{
+		return (rng() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float range(float a, float b)
+	{
+		return a + (b - a) * unit();
+	}
+
+	glm::vec3 vec(float a, float b)
+	{
+		return glm::vec3{range(a, b), range(a, b), range(a, b)};
+	}
+};
+
+inline void look(ray_tracer& rt, glm::vec3 eye, glm::vec3 target)
+{
+	rt.cam.e = eye;
+	rt.lookat(target);
+}
+
+inline void add_light(ray_tracer& rt, glm::vec3 p, glm::vec3 color)
+{
+	point_light l{p};
+	l.color = color;
+	rt.point_lights.push_back(l);
+}
+
+inline void default_materials(ray_tracer& rt)
+{
+	rt.materials.push_back(material{0.5f, 0.4f, 0.8f, 32, true});
+	rt.materials.push_back(material{0.25f, 0.4f, 0.6f, 100, true});
+	rt.materials.push_back(material{0.4f, 0.4f, 0.25f, 16, false});
+	rt.materials.push_back(material{0.5f, 0.2f, 0.2f, 8, false});
+	rt.ambient_lights.push_back(ambient_light{});
+}
+
+// a 32x32 grid of spheres of random size and color on a plane
+inline void sphere_field(ray_tracer& rt)
+{
+	scene_random random{};
+	default_materials(rt);
+	for (int i{}; i < 32; i++)
+	{
+		for (int j{}; j < 32; j++)
+		{
+			float r{random.range(0.1f, 0.35f)};
+			glm::vec3 c{(j - 15.5f) * 0.7f, r, (i - 15.5f) * 0.7f};
+			int m{static_cast<int>(random.unit() * 4) % 4};
+			rt.geo.add_sphere(c, r, m, random.vec(0.0f, 1.0f));
+		}
+	}
+	rt.geo.add_triangle(glm::vec3{-1, 0, -1}, glm::vec3{-1, 0, 1}, glm::vec3{1, 0, 1}, 3, glm::vec3{0.8f, 0.8f, 0.8f}, true);
+	add_light(rt, glm::vec3{-6, 8, -6}, glm::vec3{1, 1, 1});
+	add_light(rt, glm::vec3{6, 6, 4}, glm::vec3{0.6f, 0.6f, 0.8f});
+	look(rt, glm::vec3{0, 9, -16}, glm::vec3{0, 0, 0});
+}
+
+// small random triangles in a cube, the workload of tri_bench through the whole renderer
+inline void triangle_soup(ray_tracer& rt, int count)
+{
+	scene_random random{};
+	default_materials(rt);
+	for (int i{}; i < count; i++)
+	{
+		glm::vec3 c{random.vec(-5.0f, 5.0f)};
+		glm::vec3 p2{c + random.vec(-0.5f, 0.5f)};
+		glm::vec3 p3{c + random.vec(-0.5f, 0.5f)};
+		rt.geo.add_triangle(c, p2, p3, 2 + i % 2, random.vec(0.0f, 1.0f));
+	}
+	add_light(rt, glm::vec3{-8, 10, -12}, glm::vec3{1, 1, 1});
+	add_light(rt, glm::vec3{8, 4, -10}, glm::vec3{0.5f, 0.5f, 0.5f});
+	look(rt, glm::vec3{0, 1, -9}, glm::vec3{0, 0, 0});
+}
+
+// the built-in scene lit by 32 point lights on a ring above it
+inline void many_lights(ray_tracer& rt)
+{
+	scene_load_stats stats{};
+	load_scene_text(rt, default_scene_text, stats);
+	rt.point_lights.clear();
+	scene_random random{};
+	for (int l{}; l < 32; l++)
+	{
+		float a{l * 6.2831853f / 32};
+		glm::vec3 color{random.vec(0.0f, 1.0f)};
+		add_light(rt, glm::vec3{6 * std::cos(a), random.range(4.0f, 6.0f), 6 * std::sin(a)}, color * (2.0f / 32));
+	}
+}
+
+// spheres between two parallel glazed walls, the reflections bounce between them until bounce_count
+inline void mirror_hall(ray_tracer& rt)
+{
+	rt.materials.push_back(material{0.1f, 0.2f, 0.9f, 64, true});
+	rt.materials.push_back(material{0.3f, 0.5f, 0.6f, 32, true});
+	rt.materials.push_back(material{0.4f, 0.6f, 0.2f, 8, false});
+	rt.ambient_lights.push_back(ambient_light{});
+	glm::vec3 silver{0.9f, 0.9f, 0.95f};
+	for (float x : {-4.0f, 4.0f})
+	{
+		rt.geo.add_triangle(glm::vec3{x, -1, -40}, glm::vec3{x, 10, -40}, glm::vec3{x, -1, 40}, 0, silver, true);
+	}
+	rt.geo.add_triangle(glm::vec3{-1, 0, -1}, glm::vec3{-1, 0, 1}, glm::vec3{1, 0, 1}, 2, glm::vec3{0.7f, 0.7f, 0.7f}, true);
+	scene_random random{};
+	for (int i{}; i < 24; i++)
+	{
+		glm::vec3 c{random.range(-3.0f, 3.0f), random.range(0.5f, 2.5f), random.range(-6.0f, 6.0f)};
+		float r{random.range(0.3f, 0.7f)};
+		rt.geo.add_sphere(c, r, 1 + i % 2, random.vec(0.0f, 1.0f));
+	}
+	add_light(rt, glm::vec3{0, 8, -4}, glm::vec3{1, 1, 1});
+	add_light(rt, glm::vec3{2, 5, 6}, glm::vec3{0.5f, 0.4f, 0.3f});
+	look(rt, glm::vec3{-2.5f, 3, -12}, glm::vec3{1, 1.5f, 0});
+}
+
+// the scene the application starts with
+inline void builtin(ray_tracer& rt)
+{
+	scene_load_stats stats{};
+	load_scene_text(rt, default_scene_text, stats);
+}
+
+#endif
@@ -0,0 +1,83 @@
+// compares the prepared moller-trumbore triangle kernel against the original per-ray kernel
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "geometry.h"
+
+// triangle::intersect as it was before the prepare step, everything is derived from the vertices per ray
+static hit_information intersect_reference(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, ray& view_ray)
+{
+	hit_information h{};
+	glm::vec3 normal{glm::normalize(glm::cross(p2-p1,p3-p1))};
+
+	h.t=glm::dot(p1-view_ray.p, normal)/glm::dot(normal, view_ray.d);
+	if (h.t < 0)
+	{
+		return h;
+	}
+	glm::vec3 x{view_ray.evaluate(h.t)};
+	float e1{glm::dot(glm::cross(p2-p1, x-p1), normal)};
+	float e2{glm::dot(glm::cross(p3-p2, x-p2), normal)};
+	float e3{glm::dot(glm::cross(p1-p3, x-p3), normal)};
+	if (e1 > 0 && e2 > 0 && e3 > 0)
+	{
+		h.normal=normal;
+		h.hits=1;
+	}
+	return h;
+}
+
+int main(int argc, char** argv)
+{
+	int triangles{argc > 1 ? std::atoi(argv[1]) : 4096};
+	int rays{argc > 2 ? std::atoi(argv[2]) : 1024};
+
+	std::mt19937 rng{1};
+	std::uniform_real_distribution<float> pos{-5.0f, 5.0f};
+	std::uniform_real_distribution<float> off{-0.5f, 0.5f};
+
+	geometry_store geo{};
+	for (int i{}; i < triangles; i++)
+	{
+		glm::vec3 c{pos(rng), pos(rng), pos(rng)};
+		geo.add_triangle(c, c + glm::vec3{off(rng), off(rng), off(rng)}, c + glm::vec3{off(rng), off(rng), off(rng)}, 0);
+	}
+	geo.prepare();
+
+	std::vector<ray> ray_list{};
+	for (int i{}; i < rays; i++)
+	{
+		ray_list.push_back(ray{glm::vec3{pos(rng), pos(rng), -10.0f}, glm::normalize(glm::vec3{off(rng), off(rng), 1.0f})});
+	}
+
+	using clock = std::chrono::steady_clock;
+	long long hits_reference{};
+	auto t0{clock::now()};
+	for (ray& r : ray_list)
+	{
+		for (int i{}; i < triangles; i++)
+		{
+			hits_reference += intersect_reference(geo.tri_p1[i], geo.tri_p2[i], geo.tri_p3[i], r).hits;
+		}
+	}
+	auto t1{clock::now()};
+	long long hits_prepared{};
+	for (ray& r : ray_list)
+	{
+		for (int i{}; i < triangles; i++)
+		{
+			hits_prepared += geo.intersect_triangle(i, r).hits;
+		}
+	}
+	auto t2{clock::now()};
+
+	double tests{(double)triangles * rays};
+	double reference_ms{std::chrono::duration<double, std::milli>(t1 - t0).count()};
+	double prepared_ms{std::chrono::duration<double, std::milli>(t2 - t1).count()};
+	std::printf("%d triangles x %d rays\n", triangles, rays);
+	std::printf("reference: %8.2f ms  %6.1f Mtests/s  %lld hits\n", reference_ms, tests / reference_ms / 1e3, hits_reference);
+	std::printf("prepared : %8.2f ms  %6.1f Mtests/s  %lld hits\n", prepared_ms, tests / prepared_ms / 1e3, hits_prepared);
+	std::printf("speedup  : %.2fx\n", reference_ms / prepared_ms);
+}